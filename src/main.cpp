@@ -1,7 +1,11 @@
 #include <Arduino.h>
+#include <utility>
 #include <FastLED.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
+#include <WiFiUdp.h>
+#include <LittleFS.h>
+#include <Updater.h>
 
 // include 1D FX effects
 #include "fx/1d/cylon.h"
@@ -13,13 +17,18 @@
 
 using namespace fl;
 
+// ESP.getVcc() 需要把 ADC 切到量測供電電壓
+ADC_MODE(ADC_VCC);
+
 // ========== WiFi 配置 ==========
 #define TOY_SSID "funXled"  // WiFi名稱
 #define TOY_PWD "12345678"    // WiFi密碼（至少8位）
 
 // ========== LED配置 (ESP01S只有GPIO0和GPIO2可用) ==========
 #define LED_PIN 2           // GPIO2 - 內建LED, 和WS2812燈帶共用
-#define NUM_LEDS 8          // 8個LED
+#ifndef NUM_LEDS
+#define NUM_LEDS 8          // 8個LED（最多 255：預覽與烘焙格式以 1 位元組存索引 / 數量）
+#endif
 #define COLOR_ORDER GRB     // WS2812色序
 #define CHIPSET WS2812B     // LED晶片類型
 CRGBArray<NUM_LEDS> leds;   // LED陣列
@@ -28,6 +37,49 @@ CRGBArray<NUM_LEDS> leds;   // LED陣列
 #define VIBRATION_PIN 0     // GPIO0 - 震動感應器
 #define VIBRATION_THRESHOLD 600 // 震動觸發閾值 (根據實際情況調整)
 
+// ========== 幀率 ==========
+#define FRAME_INTERVAL_MS 30  // 效果渲染間隔 ms
+unsigned long nextFrameTime = 0;  // 下一次渲染的 millis()
+
+// ========== 輸出級（gamma / 白平衡 / 時間抖動）==========
+// 效果以 FRAME_INTERVAL_MS 渲染到 leds；輸出級每幀把 leds 轉成 8.8 定點目標值一次，
+// 再以 OUTPUT_REFRESH_HZ 高頻刷新燈帶，用誤差累積做時間抖動（只需加法）
+#define OUTPUT_REFRESH_HZ 200
+#define OUTPUT_REFRESH_US (1000000UL / OUTPUT_REFRESH_HZ)
+#define OUTPUT_GAMMA 2.2f
+#define OUTPUT_DITHER_MASK 0x80       // 只抖動最高 1 位小數，最慢的抖動週期 2 次刷新
+#define OUTPUT_DITHER_MIN_HZ 100      // 最慢的抖動週期不低於此頻率，低亮度時才不會看到閃爍
+// 保留的最低小數位決定最慢週期：256 / 最低位 次刷新
+static_assert(OUTPUT_REFRESH_HZ * (OUTPUT_DITHER_MASK & -OUTPUT_DITHER_MASK) / 256 >= OUTPUT_DITHER_MIN_HZ,
+              "OUTPUT_DITHER_MASK too fine for OUTPUT_REFRESH_HZ: slowest dither cycle would flicker");
+#define OUTPUT_WHITE_BALANCE 0xFFB0F0 // 同 FastLED TypicalLEDStrip
+CRGB outLeds[NUM_LEDS];               // 實際送到燈帶的資料
+uint16_t outTarget[NUM_LEDS][3];      // 8.8 定點目標值（已含 gamma、白平衡、亮度）
+uint8_t outError[NUM_LEDS][3];        // 時間抖動累積誤差
+uint16_t gammaLut[256];               // 8-bit 輸入 → 8.8 線性輸出
+uint8_t ledBrightness = 255;          // 使用者亮度（取代 FastLED.setBrightness）
+bool outputDirty = false;             // 目標值已更新、尚未送出
+bool outputDithering = false;         // 目標值含小數，需要持續刷新
+unsigned long lastRefresh = 0;        // micros()
+
+// ========== 電源預算 ==========
+// 在 outputLoad() 同一趟迴圈中估算燈帶電流；超出預算時縮小下一幀的比例，
+// 並在供電電壓下降時收緊預算，避免電池經 5V 升壓被拉到 brownout
+#define POWER_BUDGET_MA 400          // 預設燈帶電流預算 mA
+#define POWER_MA_PER_CHANNEL 20      // 每個 R/G/B 通道全亮電流 mA
+#define POWER_MA_IDLE_PER_LED 1      // 每顆 LED 靜態電流 mA
+#define POWER_VCC_FULL_MV 3200       // 高於此電壓使用完整預算
+#define POWER_VCC_MIN_MV 2900        // 低於此電壓只剩 POWER_VCC_MIN_PERCENT
+#define POWER_VCC_MIN_PERCENT 20
+#define POWER_VCC_INTERVAL_MS 1000   // 量測 Vcc 間隔
+uint16_t powerBudgetMa = POWER_BUDGET_MA;   // 使用者設定的預算（0 = 不限制）
+uint16_t powerEffectiveMa = POWER_BUDGET_MA; // 依 Vcc 收緊後的預算
+uint16_t powerScale = 256;           // 套用到下一幀的比例，256 = 不限制
+uint16_t powerEstimateMa = 0;        // 最近一幀的估計電流
+uint16_t vccMillivolts = 0;
+uint32_t powerLimitedFrames = 0;
+unsigned long lastVccCheck = 0;
+
 // ========== 變數 ==========
 unsigned long lastVibrationTime = 0;
 int animationMode = 0;
@@ -54,7 +106,57 @@ CRGB monoColor = CRGB::Cyan;  // 單色模式顏色
 #define MODE_DEMO_BPM 15
 #define MODE_MONO 16
 #define MODE_CLEARLED 17
-#define MODE_COUNT 18 // 更新總模式數
+#define MODE_CUSTOM 18
+#define MODE_COUNT 19 // 更新總模式數
+
+// ========== 幀插值 ==========
+// 變化平滑、只依時間計算的效果每 N 幀才渲染一個關鍵幀，中間幀由上兩個關鍵幀線性混合。
+// 逐幀累積狀態（淡出、隨機、逐幀步進）的效果維持 N = 1，否則速度會改變
+const uint8_t renderDivisor[MODE_COUNT] PROGMEM = {
+  3,  // MODE_RAINBOW
+  1,  // MODE_FLASH
+  2,  // MODE_BREATH（每 50ms 步進一次，60ms 關鍵幀不影響速度）
+  1,  // MODE_CHASE
+  1,  // MODE_CYLON
+  1,  // MODE_FIRE
+  3,  // MODE_NOISE
+  4,  // MODE_PACIFICA
+  3,  // MODE_PRIDE
+  2,  // MODE_TWINKLE
+  3,  // MODE_DEMO_RAINBOW
+  1,  // MODE_DEMO_GLITTER
+  1,  // MODE_DEMO_CONFETTI
+  1,  // MODE_DEMO_SINELON
+  1,  // MODE_DEMO_JUGGLE
+  2,  // MODE_DEMO_BPM
+  1,  // MODE_MONO
+  1,  // MODE_CLEARLED
+  2,  // MODE_CUSTOM
+};
+CRGB keyPrev[NUM_LEDS];      // 上一個關鍵幀；leds 保存最新關鍵幀（效果的累積狀態）
+CRGB interpOut[NUM_LEDS];    // 混合後的輸出幀
+uint8_t interpStep = 0;
+int interpMode = -1;
+
+// ========== 預先渲染佇列 ==========
+// 在 loop() 的空檔先渲染之後幾幀（效果時間設為該幀的顯示時間），到時間只需取出送給輸出級，
+// handleClient() 等耗時工作與渲染不再疊加在同一幀。直接讀 millis() 計時的效果不預先渲染。
+// 丟棄佇列時效果時間退回下一格重新渲染（最多倒退 RENDER_AHEAD_FRAMES 幀），設定改變在一幀內就看得到
+#define RENDER_AHEAD_FRAMES 4   // 必須為 2 的冪次
+struct QueuedFrame {
+  CRGB px[NUM_LEDS];
+  uint32_t due;         // 預定顯示的 millis()
+  uint32_t renderUs;
+  int mode;
+};
+QueuedFrame renderQueue[RENDER_AHEAD_FRAMES];
+uint8_t renderQueueHead = 0;
+uint8_t renderQueueCount = 0;
+uint32_t renderQueueDepthPops[RENDER_AHEAD_FRAMES + 1];  // 依取出時的佇列深度計數，用來決定佇列大小
+uint32_t renderUnderruns = 0;   // 該顯示時佇列是空的
+uint32_t renderHolds = 0;       // 丟棄佇列後，效果時間已超前而保留上一幀畫面的次數
+uint32_t renderCursor = 0;      // 下一幀的效果時間（最後渲染的 due + 幀間隔）
+int32_t renderLead = 0;         // 預先渲染時效果時間比 millis() 提前的 ms
 
 // FX objects (created with NUM_LEDS)
 Cylon cylon(NUM_LEDS);
@@ -67,25 +169,509 @@ TwinkleFox twinklefox(NUM_LEDS);
 // demo pattern state
 uint8_t demoHue = 0;
 
+// ========== 亂數產生器 ==========
+// 所有效果共用一個 xorshift32：每次只要 3 個位移 / XOR，一次產生 4 個隨機位元組。
+// 正式環境以硬體亂數播種；編譯時加 -DRNG_SEED=N 或呼叫 /api/seed 可固定種子重現畫面
+uint32_t rngState = 1;
+uint32_t rngSeedValue = 0;
+
+inline uint32_t rng32() {
+  uint32_t x = rngState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rngState = x;
+}
+inline uint8_t rng8() { return rng32() >> 24; }
+inline uint16_t rng16() { return rng32() >> 16; }
+// 0..n-1，以乘法取代取餘數
+inline uint16_t rngBelow(uint16_t n) { return ((uint32_t)rng16() * n) >> 16; }
+
+// ========== 編譯期特化效果（Effect<N>）==========
+// 燈帶長度 N 是模板參數，每像素常數（色相偏移、調色盤索引、節拍範圍）以 constexpr 計算。
+// N ≤ EFFECT_UNROLL_MAX 時迴圈完全展開，這些常數直接折疊成指令立即值；
+// 較長的燈帶使用一般迴圈，除以 N 也會被編譯成乘法與位移。
+// 每像素的 lambda 標成 always_inline，展開後不留呼叫。
+// （ESP8266 沒有 SIMD 指令，長燈帶不做向量化）
+#define EFFECT_UNROLL_MAX 16
+
+template <uint16_t N>
+struct Effect {
+  static constexpr uint16_t last = N - 1;
+
+  // 第 i 顆在 0..span 之間的平均分布位置
+  static constexpr uint8_t spread(uint16_t i, uint16_t span) { return i * span / N; }
+
+  template <typename F>
+  static inline __attribute__((always_inline)) void forEach(F f) {
+    if constexpr (N <= EFFECT_UNROLL_MAX) {
+      unrolled(f, std::make_integer_sequence<uint16_t, N>{});
+    } else {
+      for (uint16_t i = 0; i < N; i++) f(i);
+    }
+  }
+
+  static void fill(CRGB* out, const CRGB& color) {
+    forEach([&](uint16_t i) __attribute__((always_inline)) { out[i] = color; });
+  }
+
+  // 同 fadeToBlackBy(out, N, amount)
+  static void fade(CRGB* out, uint8_t amount) {
+    forEach([&](uint16_t i) __attribute__((always_inline)) { out[i].nscale8(255 - amount); });
+  }
+
+  static void rainbowCycle(CRGB* out, uint8_t hue, uint8_t brightness) {
+    forEach([&](uint16_t i) __attribute__((always_inline)) { out[i] = CHSV(hue + spread(i, 255), 255, brightness); });
+  }
+
+  // 同 fill_rainbow(out, N, hue, Delta)
+  template <uint8_t Delta>
+  static void rainbow(CRGB* out, uint8_t hue) {
+    forEach([&](uint16_t i) __attribute__((always_inline)) { out[i] = CHSV(hue + (uint8_t)(i * Delta), 240, 255); });
+  }
+
+  // demoBpm：調色盤索引 hue + 2i，亮度 beat - hue + 10i
+  static void bpm(CRGB* out, const CRGB* lut, uint8_t hue, uint8_t beat) {
+    forEach([&](uint16_t i) __attribute__((always_inline)) {
+      CRGB c = lut[(uint8_t)(hue + i * 2)];
+      c.nscale8(beat - hue + (uint8_t)(i * 10));
+      out[i] = c;
+    });
+  }
+
+ private:
+  template <typename F, uint16_t... I>
+  static inline __attribute__((always_inline)) void unrolled(F& f, std::integer_sequence<uint16_t, I...>) {
+    (f(I), ...);
+  }
+};
+typedef Effect<NUM_LEDS> Strip;
+
 
 // ========== 呼吸燈模式（animationMode = 2）==========
-CRGB breathingColors[] = {CRGB::Cyan, CRGB::Magenta, CRGB::Yellow, CRGB::Green, CRGB::Blue, CRGB::Red};
+const uint32_t breathingColors[] PROGMEM = {CRGB::Cyan, CRGB::Magenta, CRGB::Yellow, CRGB::Green, CRGB::Blue, CRGB::Red};
 const int numBreathingColors = sizeof(breathingColors) / sizeof(breathingColors[0]);
+#define breathingColor(i) CRGB(pgm_read_dword(&breathingColors[i]))
 int currentColorIndex = 0;           // 目前色彩索引
 CRGB currentAnimColor = CRGB::Cyan;  // 目前動畫色彩（支援插值）
 CRGB nextAnimColor = CRGB::Magenta;  // 下一個目標色彩
 unsigned long breathingCycleCount = 0; // 呼吸循環次數
 const unsigned long colorSwitchCycles = 3; // 每 3 個循環切換一次色彩
+#define BREATH_STEP_MS 60          // 呼吸亮度每步的時間
 unsigned long colorTransitionFrames = 0; // 色彩漸層進度（每個 50ms 呼吸更新一次）
 const unsigned long colorTransitionDuration = 20; // 色彩過渡持續 20 個呼吸週期（~1秒）
 
+// ========== 調色盤 ==========
+// 內建調色盤留在 flash（PROGMEM），以編號引用，不需每幀複製；
+// 使用者調色盤可經 API 上傳並存到 LittleFS。
+// 切換時 paletteTick() 每幀只混合幾個項目，並只重建受影響的查表區段，
+// 效果透過 256 項查表 paletteLut[] 取色，不必在熱路徑做 ColorFromPalette 插值
+#define PALETTE_USER_SLOTS 2
+#define PALETTE_BLEND_ENTRIES 4       // 每幀最多混合的項目數
+#define PALETTES_FILE "/palettes.bin"
+#define PALETTES_MAGIC 0x4150         // 'PA'
+const TProgmemRGBPalette16* const builtinPalettes[] = {
+  &PartyColors_p, &RainbowColors_p, &OceanColors_p, &LavaColors_p, &ForestColors_p, &CloudColors_p, &HeatColors_p,
+};
+const char* const builtinPaletteNames[] = {"party", "rainbow", "ocean", "lava", "forest", "cloud", "heat"};
+#define PALETTE_BUILTIN_COUNT (sizeof(builtinPalettes) / sizeof(builtinPalettes[0]))
+#define PALETTE_COUNT (PALETTE_BUILTIN_COUNT + PALETTE_USER_SLOTS)
+CRGB userPalettes[PALETTE_USER_SLOTS][16];
+uint8_t activePalette = 0;
+CRGB paletteCurrent[16];              // 目前（混合中）的 16 個項目
+CRGB paletteTarget[16];               // 目標調色盤
+CRGB paletteLut[256];                 // 由 paletteCurrent 線性插值展開
+uint16_t paletteBlendPending = 0;     // 尚未到達目標的項目位元遮罩
+uint8_t paletteBlendCursor = 0;
+
+// ========== 自訂效果（bytecode VM）==========
+// 使用者上傳逐像素運算式，裝置端編譯成精簡 bytecode，以整數 / 8-bit 定點運算執行。
+// 語法："色相;飽和度;亮度"，後兩段可省略（預設 255）。
+// 變數：i 像素索引、n 像素數、t 時間（每 16ms 加 1）、b 節拍（每秒 0→255）
+// 運算子：+ - * / % & | ^ << >> 與括號；函數：sin cos tri quad abs (1 參數)、
+// min max scale (2 參數，scale(a,b) = a*b/256)
+// 編譯時驗證堆疊深度，執行時不需邊界檢查；程式無迴圈，每幀最多 VM_CODE_MAX × NUM_LEDS 條指令
+// 整數運算一律以 32 位元環繞（同 uint32_t），溢位與 INT32_MIN / -1 都有定義
+#define VM_SOURCE_MAX 128
+#define VM_CODE_MAX 96
+#define VM_STACK 8
+#define VM_NEST_MAX 16           // 括號 / 函數巢狀上限（限制編譯器遞迴深度）
+// 程式長度與燈數已限制每幀最壞情況；燈數加大到超過此上限時，需要加回每幀指令預算
+static_assert(VM_CODE_MAX * NUM_LEDS <= 4096, "custom effect worst case exceeds the frame time");
+#define VM_PROGRAM_FILE "/effect.txt"
+#define VM_DEFAULT_SOURCE "i*32+t;255;sin(b+i*32)"
+char vmSource[VM_SOURCE_MAX] = VM_DEFAULT_SOURCE;
+uint8_t vmCode[VM_CODE_MAX];
+uint8_t vmCodeLen = 0;
+uint8_t vmOpsPerPixel = 0;       // 每像素指令數（無迴圈，編譯時即可確定）
+
+// ========== OTA 韌體更新 ==========
+// 上傳的映像檔邊收邊寫入 OTA 分區（不緩衝整個檔案），同時計算 CRC-32。
+// 只有完整寫入且校驗通過才會由 eboot 在重開機時切換；中途失敗時舊韌體不受影響。
+// 切換時 eboot 直接以新映像覆蓋舊韌體，沒有 A/B 分區：新韌體若無法正常開機不會自動回復，只能以 USB 重新燒錄。
+// 1MB 的 esp01_1m（64KB LittleFS）可用約 940KB，因此韌體需小於約 470KB 才能 OTA
+// AP 密碼寫在原始碼中等同公開，因此只在開機後 OTA_BOOT_WINDOW_MS 內接受上傳（需實際讓玩具重新開機）；
+// build_flags 加上 -DOTA_PASSWORD=\"...\" 時另外要求 HTTP Basic 認證（使用者 OTA_USER）
+#define OTA_FRAME_INTERVAL_MS 100    // 上傳期間降低渲染頻率
+#define OTA_BOOT_WINDOW_MS 300000UL  // 開機後接受 OTA 的時間
+#define OTA_USER "admin"
+uint32_t otaCrc = 0;
+uint32_t otaBytes = 0;
+const char* otaError = nullptr;
+unsigned long otaLastFrame = 0;
+bool otaWindowClosed = false;        // 超過開機視窗後不再開放（millis() 回繞也不會重新開放）
+bool otaAccepted = false;            // 本次上傳通過開機視窗與認證檢查
+
+// ========== 多台同步（UDP）==========
+// 一台當 leader，每 SYNC_INTERVAL_MS 在自己的 AP 子網路廣播 beacon（模式、調色盤、效果時間）；
+// follower 以 STA 連上 leader 的 AP，收到 beacon 時跟隨模式並送出一次時間戳交換，
+// 以類似 NTP 的四個時間戳估算時差，取最近幾筆中往返時間最短者，並由長時間的時差變化估算漂移。
+// 效果一律透過 effectMillis() / syncTimebase() 取得時間
+#define SYNC_PORT 4210
+#define SYNC_MAGIC 0x31535846       // 'FXS1'
+#ifndef SYNC_INTERVAL_MS
+#define SYNC_INTERVAL_MS 3000
+#endif
+#define SYNC_SAMPLES 4
+#define SYNC_DRIFT_WINDOW_MS 60000  // 至少間隔 60 秒才更新漂移估計
+#define SYNC_DRIFT_MAX_PPM 500
+#define SYNC_STEP_MS 100            // 誤差超過時直接跳到新時差，否則每次修正一半
+#define SYNC_FILE "/sync.bin"
+#define SYNC_OFF 0
+#define SYNC_LEADER 1
+#define SYNC_FOLLOWER 2
+#define SYNC_BEACON 0
+#define SYNC_REQUEST 1
+#define SYNC_REPLY 2
+
+struct __attribute__((packed)) SyncPacket {
+  uint32_t magic;
+  uint8_t type;
+  uint8_t mode;
+  uint8_t palette;
+  uint8_t reserved;
+  uint32_t t1;  // follower 送出請求的本地時間
+  uint32_t t2;  // leader 收到請求的時間
+  uint32_t t3;  // leader 送出回覆 / beacon 的時間
+};
+
+struct SyncSample {
+  uint32_t local;   // 取樣時的本地 millis()
+  int32_t offset;   // leader 時間 - 本地時間（模 2^32）
+  uint32_t rtt;
+};
+
+// follower 的時鐘模型，只由 syncEstimate() 更新；時間與時差都以模 2^32 計算，millis() 回繞不影響
+struct SyncClock {
+  bool locked;
+  int32_t offset;      // 在 base 時的時差 ms
+  int32_t driftPpm;
+  uint32_t base;
+  SyncSample samples[SYNC_SAMPLES];
+  uint8_t count;
+  SyncSample anchor;   // 估算漂移的起點
+};
+
+WiFiUDP syncUdp;
+uint8_t syncRole = SYNC_OFF;
+char syncLeaderSsid[33] = "";
+SyncClock syncClock = {};
+unsigned long syncLastBeacon = 0;
+
+// ========== 烘焙動畫（錄製 / 重播）==========
+// 把昂貴的效果錄成 LittleFS 裡的壓縮幀串流，重播時只需解碼，幾乎不耗 CPU
+// 每幀先與上一幀 XOR 再做 RLE：控制碼 0x00-0x7F = 跳過 n+1 個不變的位元組，
+// 0x80-0xFF = 其後 (n&0x7F)+1 個 XOR 位元組。每 BAKE_KEYFRAME_FRAMES 幀一個關鍵幀（與全黑幀 XOR），
+// 各關鍵幀在檔案中的位置以 uint32 索引附在幀資料之後，跳轉時只需從最近的關鍵幀解碼
+// 錄製時先編碼到 RAM，由 loop() 在幀與幀之間每累積 BAKE_WRITE_CHUNK 寫入一次 flash；
+// 片段大小受 LittleFS 剩餘空間限制（保留 BAKE_FS_RESERVE 給其他設定檔），空間不夠時提前結束錄製
+#define BAKE_MAGIC 0x4B42
+#define BAKE_VERSION 2
+#define BAKE_SECONDS_MAX 60
+#define BAKE_KEYFRAME_FRAMES 32  // 關鍵幀間隔：跳轉時最多解碼這麼多幀
+#define BAKE_KEYFRAMES_MAX (BAKE_SECONDS_MAX * 1000 / FRAME_INTERVAL_MS / BAKE_KEYFRAME_FRAMES + 1)
+#define BAKE_FRAME_BYTES (NUM_LEDS * 3)
+#define BAKE_READ_CHUNK 64   // 每次從 flash 讀取的位元組數
+#define BAKE_WRITE_CHUNK 256 // 每次寫入 flash 的位元組數（LittleFS 一個 program 單位）
+#define BAKE_FS_RESERVE 8192 // 錄製時至少留給其他檔案的空間
+#define BAKE_NO_PALETTE 0xFF // 片段與調色盤無關
+
+#define BAKE_IDLE 0
+#define BAKE_PLAYING 1
+#define BAKE_RECORDING 2
+
+struct __attribute__((packed)) BakeHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t mode;
+  uint8_t numLeds;
+  uint8_t palette;     // 錄製時的調色盤，BAKE_NO_PALETTE = 與調色盤無關
+  uint16_t frameCount;
+  uint16_t frameMs;
+  uint16_t keyInterval; // 關鍵幀間隔（幀）
+};
+
+uint32_t bakeMask = 0;                 // bit n = 模式 n 有烘焙片段
+uint8_t bakeState = BAKE_IDLE;
+int bakeCheckedMode = -1;              // 已檢查過片段的模式，切換模式時重新開檔
+File bakeFile;
+uint16_t bakeFrames = 0;               // 重播：片段總幀數；錄製：已錄幀數
+uint16_t bakeFrameIndex = 0;           // 重播：從片段開頭算起已解碼的幀數
+uint16_t bakeFrameMs = FRAME_INTERVAL_MS;
+uint16_t bakeRecordTarget = 0;
+uint8_t bakeFrame[BAKE_FRAME_BYTES];   // 上一幀（錄製與重播共用）
+uint8_t bakeBuf[BAKE_READ_CHUNK];
+uint8_t bakeBufLen = 0;
+uint8_t bakeBufPos = 0;
+uint8_t bakeOut[BAKE_WRITE_CHUNK + BAKE_FRAME_BYTES * 2];  // 錄製：尚未寫入 flash 的編碼資料
+uint16_t bakeOutLen = 0;
+uint32_t bakeBytes = 0;                // 錄製：片段目前大小（含標頭與未寫入部分）
+uint32_t bakeBytesLimit = 0;           // 錄製：依剩餘空間算出的片段大小上限
+uint32_t bakeKeyOffsets[BAKE_KEYFRAMES_MAX];  // 錄製：各關鍵幀的檔案位置，錄完時寫成索引
+uint16_t bakeKeyInterval = BAKE_KEYFRAME_FRAMES;  // 重播：片段的關鍵幀間隔
+uint32_t bakeIndexPos = 0;             // 重播：關鍵幀索引在檔案中的位置
+uint32_t bakeFramesDecoded = 0;        // 重播：累計解碼幀數（含跳轉時的追趕）
+
 // ========== 閒置/睡眠管理 ==========
+// 閒置時逐段省電：降亮度與幀率 → 降低發射功率 / modem sleep → 幀間休眠 → 深度睡眠
+// soft-AP 需持續送 beacon，AP 模式下 SDK 不會真正進入 modem / light sleep，
+// 實際省下的是燈帶電流、CPU 渲染與輸出刷新、以及發射功率
+#define IDLE_ACTIVE 0
+#define IDLE_DIM 1
+#define IDLE_RADIO 2
+#define IDLE_LIGHT 3
+#define IDLE_STAGES 4
+#define IDLE_DIM_SCALE 64           // 亮度 ×64/256
+#define IDLE_DIM_FRAME_MS 60        // IDLE_DIM / IDLE_RADIO 的渲染間隔
+#define IDLE_LIGHT_FRAME_MS 120     // IDLE_LIGHT 的渲染間隔
+#define IDLE_LIGHT_DELAY_MS 20      // IDLE_LIGHT 時 loop() 每次休眠的時間
+#define IDLE_TX_POWER_DBM 8.0f      // IDLE_RADIO 起的發射功率（正常 20.5 dBm）
+#define IDLE_FILE "/idle.bin"
+#define IDLE_MAGIC 0x4449      // 'ID'
+#define IDLE_VERSION 1
 unsigned long lastActivity = 0;       // 最後活動時間（ms）
-unsigned long idleTimeout = 300000;   // 閒置超時 ms (預設 300000ms = 5 分鐘)
+unsigned long idleTimeout = 300000;   // 閒置超時 ms (預設 300000ms = 5 分鐘)，0 = 不睡眠
+uint32_t idleThresholdMs[IDLE_STAGES] = {0, 60000, 120000, 180000};  // 進入各階段的閒置時間，0 = 略過
+uint8_t idleStage = IDLE_ACTIVE;
+unsigned long idleStageSince = 0;
+uint32_t idleStageTotalMs[IDLE_STAGES];   // 各階段累計時間
+uint16_t frameIntervalMs = FRAME_INTERVAL_MS;
+
+// ========== 播放清單（定時輪播預設）==========
+// 每個預設 7 bytes，整張表以緊湊二進位格式存放在 LittleFS
+struct __attribute__((packed)) PlaylistPreset {
+  uint8_t mode;         // 動畫模式
+  uint8_t brightness;   // 亮度 0-255
+  uint8_t r, g, b;      // 單色模式顏色
+  uint16_t seconds;     // 持續秒數
+};
+#define PLAYLIST_MAX 16
+#define PLAYLIST_FILE "/playlist.bin"
+#define PLAYLIST_MAGIC 0x4C50   // 'PL'
+#define PLAYLIST_VERSION 1
+
+// 檔案標頭：magic(2) + version(1) + count(1) + enabled(1)，之後接 count 筆預設
+struct __attribute__((packed)) PlaylistHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;
+  uint8_t enabled;
+};
+
+// 首次開機（尚無檔案）時使用的預設清單
+const PlaylistPreset defaultPlaylist[] PROGMEM = {
+  {MODE_RAINBOW,  255, 0, 255, 255, 30},
+  {MODE_PACIFICA, 255, 0, 255, 255, 30},
+  {MODE_PRIDE,    255, 0, 255, 255, 30},
+  {MODE_TWINKLE,  255, 0, 255, 255, 30},
+};
+
+PlaylistPreset playlist[PLAYLIST_MAX];
+uint8_t playlistCount = 0;
+uint8_t playlistIndex = 0;
+bool playlistEnabled = false;
+unsigned long playlistNextSwitch = 0;  // 下一次切換的 millis()
+
+// ========== 執行期指標（/api/metrics, Prometheus 格式）==========
+// 以 2 的冪次 µs 分桶：bucket k 計數 ≤ 2^k µs 的樣本，最後一桶為 +Inf
+// 收集只做固定成本的計數，不配置記憶體
+#define HIST_BUCKETS 18
+struct Histogram {
+  uint32_t buckets[HIST_BUCKETS];
+  uint32_t count;
+  uint64_t sumUs;
+};
+Histogram animHist;   // updateAnimation()
+Histogram showHist;   // FastLED.show()
+Histogram loopHist;   // 有做事的 loop() 工作時間（不含幀間 delay；只輪詢的空迴圈不記錄）
+Histogram httpHist;   // 有處理請求的 server.handleClient()
+uint32_t vibrationEvents = 0;
+uint32_t framesRendered = 0;
+uint32_t framesDropped = 0;    // 相對 FRAME_INTERVAL_MS 節奏漏掉的幀數
+uint32_t httpRequests = 0;
+
+// 各模式累計的幀數、渲染時間與估計燈帶電流，test/host/fleet_sim.cpp 也以此統計各模式的渲染時間
+struct ModeStats {
+  uint32_t frames;
+  uint64_t renderUs;
+  uint64_t ledMaFrames;   // 每幀 powerEstimateMa 的總和
+};
+ModeStats modeStats[MODE_COUNT];
+
+// ========== Hot-path trace 記錄器 ==========
+// 編譯時以 -DTRACE_ENABLED=1 開啟；關閉時 TRACE_SCOPE 完全不產生程式碼
+// 每個 scope 結束時以 CPU cycle 計數寫入固定大小的環形緩衝區
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#define TRACE_HTTP 0
+#define TRACE_VIBRATION 1
+#define TRACE_ANIMATION 2
+#define TRACE_SHOW 3
+
+#if TRACE_ENABLED
+// 每秒約 33 筆 updateAnimation + 最多 OUTPUT_REFRESH_HZ 筆 show（抖動時），空的 handleClient 輪詢不記錄；
+// 1024 筆（8KB）約可涵蓋最近 4 秒，序列埠或網頁來得及在卡頓被覆蓋前匯出
+#define TRACE_RING_SIZE 1024  // 必須為 2 的冪次
+struct TraceRecord {
+  uint32_t start;            // ESP.getCycleCount()
+  uint32_t cycles16 : 24;    // 持續 cycle 數 / 16
+  uint32_t id : 8;
+};
+TraceRecord traceRing[TRACE_RING_SIZE];
+uint32_t traceTotal = 0;     // 累計寫入筆數
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+struct TraceScope {
+  uint32_t start;
+  uint8_t id;
+  bool keep = true;          // 設為 false 時不寫入（例如沒有處理到請求的輪詢）
+  explicit TraceScope(uint8_t scopeId) : start(ESP.getCycleCount()), id(scopeId) {}
+  ~TraceScope() {
+    if (!keep) return;
+    uint32_t cycles16 = (ESP.getCycleCount() - start) >> 4;
+    TraceRecord& r = traceRing[traceTotal++ & (TRACE_RING_SIZE - 1)];
+    r.start = start;
+    r.cycles16 = cycles16 > 0xFFFFFF ? 0xFFFFFF : cycles16;
+    r.id = id;
+  }
+};
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(id) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(id)
+// 具名 scope：結束前可用 TRACE_KEEP 決定是否寫入
+#define TRACE_SCOPE_AS(var, id) TraceScope var(id)
+#define TRACE_KEEP(var, cond) (var).keep = (cond)
+#else
+#define TRACE_SCOPE(id) do {} while (0)
+#define TRACE_SCOPE_AS(var, id) do {} while (0)
+#define TRACE_KEEP(var, cond) do {} while (0)
+#endif
+
+// ========== 記憶體配置追蹤 ==========
+// 編譯時以 -DALLOC_TRACKING=1 並連結 -Wl,--wrap=malloc,... 開啟（見 platformio.ini 的 debug env）
+// 依區段統計 malloc/new 次數、位元組數、仍佔用與最高佔用量；每塊記住配置時的區段，
+// 釋放與 realloc 記到原本的區段。序列埠指令 a 輸出並歸零
+// 穩定運作後的幀內配置、或 handler 第一次以後的請求中的任何配置（延遲初始化只允許在第一次）視為違規：
+// 預設警告一次並附上呼叫位址，
+// 加上 -DALLOC_STRICT=1 則直接 abort()（測試用）
+#ifndef ALLOC_TRACKING
+#define ALLOC_TRACKING 0
+#endif
+#ifndef ALLOC_STRICT
+#define ALLOC_STRICT 0
+#endif
+
+#define ALLOC_OTHER 0
+#define ALLOC_FRAME 1     // renderInto() / presentFrame()
+#define ALLOC_MODE 2      // setAnimationMode()
+#define ALLOC_HTTP 3      // server.handleClient() 解析請求與送出回應
+#define ALLOC_HANDLER_FIRST 4     // 各 handler 依 URI 各佔一個區段（beginRequest() 指定）
+#define ALLOC_HANDLER_SLOTS 28
+#define ALLOC_REGIONS (ALLOC_HANDLER_FIRST + ALLOC_HANDLER_SLOTS)
+
+#if ALLOC_TRACKING
+#define ALLOC_WARMUP_FRAMES 100   // 開機後前幾幀允許配置（Fx 初始化等）
+#define ALLOC_URI_MAX 24
+struct AllocStats {
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t bytes;       // 累計配置的位元組
+  uint32_t live;        // 目前仍佔用的位元組（不因 allocDump 歸零）
+  uint32_t peak;        // live 的最高值
+  uint32_t minFreeHeap;
+  uint32_t requests;    // handler 區段：被呼叫次數
+  void* lastCaller;
+};
+AllocStats allocStats[ALLOC_REGIONS];
+char allocHandlerUri[ALLOC_HANDLER_SLOTS][ALLOC_URI_MAX];
+uint8_t allocRegion = ALLOC_OTHER;
+uint32_t allocFrameViolations = 0;
+uint32_t allocRequestViolations = 0;
+uint8_t allocRequestRegion = ALLOC_OTHER;   // 目前請求的 handler 區段，沒有請求時為 ALLOC_OTHER
+uint32_t allocRequestLive = 0;              // 請求開始時該區段的 live
+uint32_t allocRequestAllocs = 0;            // 請求開始時該區段的 allocs
+
+struct AllocScope {
+  uint8_t prev;
+  explicit AllocScope(uint8_t region) : prev(allocRegion) { allocRegion = region; }
+  ~AllocScope() { allocRegion = prev; }
+};
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+#define ALLOC_SCOPE(region) AllocScope ALLOC_CONCAT(allocScope_, __LINE__)(region)
+#else
+#define ALLOC_SCOPE(region) do {} while (0)
+#endif
 
 // ========== Web服務器 ==========
 ESP8266WebServer server(80);
 
+// ========== 分段回應（chunked streaming）==========
+// 大型回應從 server 分離後，每次 loop() 只在 STREAM_BUDGET_US 內送出 TCP 視窗容得下的資料，
+// 慢速手機連線只會拖慢自己的下載，不會卡住動畫
+#define STREAM_SLOTS 2
+#define STREAM_CHUNK (536 - 7)    // 加上 chunk 標頭 "XXX\r\n" 與結尾 "\r\n" 剛好一個 TCP MSS
+#define STREAM_BUDGET_US 3000     // 每次 loop 花在送資料的上限，遠小於一幀
+#define STREAM_TIMEOUT_MS 10000   // 對方停止接收多久後放棄
+#define STREAM_STEP_MAX 256       // 邊產生邊送的回應，每段輸出的上限
+
+// 邊產生邊送的回應：寫出第 step 段並回傳 true，沒有下一段時回傳 false
+typedef bool (*StreamStep)(Print& out, uint16_t step);
+
+struct ResponseStream {
+  WiFiClient client;
+  PGM_P body;          // 固定內容（flash）
+  size_t len;
+  size_t pos;
+  StreamStep step;     // 非 nullptr 時改由 step() 逐段產生 body，pos 為下一段的編號
+  unsigned long lastProgress;
+  bool active;
+};
+ResponseStream streams[STREAM_SLOTS];
+
+// ========== LED 即時預覽 ==========
+// /api/preview 以 chunked 二進位串流送出顯示中的畫面，每則訊息只含與上次送出不同的 LED：
+// [數量 k][索引 R G B] × k。畫面沒變就不送，沒有觀看者時完全不做事
+#define PREVIEW_SLOTS 2
+#define PREVIEW_FPS_DEFAULT 10
+#define PREVIEW_FPS_MAX 30
+#define PREVIEW_TIMEOUT_MS 5000   // 有變化卻一直送不出去多久後放棄（對方停止接收）
+static_assert(NUM_LEDS <= 255, "preview messages carry LED index and count in one byte");
+struct PreviewClient {
+  WiFiClient client;
+  CRGB sent[NUM_LEDS];      // 瀏覽器目前顯示的顏色（初始為黑）
+  uint16_t intervalMs;
+  unsigned long lastSend;
+  unsigned long lastProgress;  // 最近一次送出訊息或確認不需送出的時間
+  bool active;
+};
+PreviewClient previews[PREVIEW_SLOTS];
+uint8_t previewCount = 0;
+CRGB displayFrame[NUM_LEDS];  // 最近一次交給輸出級的幀
+
 // ========== 函數聲明 ==========
 void handleVibration();
 void updateAnimation();
@@ -103,19 +689,110 @@ void demoSinelon();
 void demoJuggle();
 void demoBpm();
 
+void rngSeed(uint32_t seed);
+void rngFill(uint8_t* buf, size_t len);
+void handleSeed();
+
 void setAnimationMode(int mode);
+const CRGB* interpRender();
+void renderFrame();
+bool renderAhead();
+void renderPresentDue(uint32_t due);
+void renderAheadFlush();
+void initOutput();
+void outputLoad(const CRGB* src);
+void outputRefresh();
+void powerUpdateVcc();
+void handleSetPowerBudget();
 void initWiFi();
 void handleRoot();
 void handleAPI();
+bool streamBegin(const char* contentType, PGM_P body, size_t len);
+bool streamBeginSteps(const char* contentType, StreamStep step);
+bool streamService();
+void handlePreview();
+bool previewService();
 void handleSetMode();
 void handleSetBrightness();
 void handleSetColor();
 void handleToggleAuto();
 void resetIdleTimer();
+void beginRequest();
 void enterDeepSleep();
+void loadIdleConfig();
+void idleService();
+uint32_t idleStageSeconds(uint8_t stage);
+void handleIdle();
+
+// metrics
+void histObserve(Histogram& h, uint32_t us);
+bool writeMetricsStep(Print& out, uint16_t step);
+void handleMetrics();
+
+// trace / serial console
+void handleSerialCommand();
+#if ALLOC_TRACKING
+void allocDump(Print& out);
+void allocBeginRequest(const char* uri);
+void allocEndRequest();
+void allocViolation(uint32_t& counter, const char* message, void* caller);
+#endif
+#if TRACE_ENABLED
+void traceDump(Print& out);
+void handleTrace();
+#endif
+
+// playlist
+void loadPlaylist();
+void savePlaylist();
+void playlistApply(uint8_t index);
+void playlistAdvance();
+void handlePlaylist();
+void handleSetPreset();
+void handleDeletePreset();
+void handleTogglePlaylist();
+
+// palettes
+void loadPalettes();
+void savePalettes();
+void paletteSelect(uint8_t id, bool immediate);
+void paletteTick();
+void handlePalettes();
+void handleSetPalette();
+void handleUploadPalette();
+
+// OTA
+void handleUpdateUpload();
+void handleUpdateDone();
+
+// sync
+uint32_t effectMillis();
+uint32_t syncTimebase();
+void loadSyncConfig();
+void syncStart();
+void syncService();
+void handleSync();
+
+// custom effect VM
+const char* vmCompile(const char* src, uint8_t* code, uint8_t& codeLen, uint8_t& ops, int& errorPos);
+void vmRender();
+void loadProgram();
+void handleProgram();
+void handleSetProgram();
+void runBenchmark();
+
+// baked animations
+void bakeScan();
+const char* bakeStart(uint8_t mode, uint16_t seconds);
+bool bakeRender(CRGB* out);
+void bakeRecordFrame(const CRGB* src);
+bool bakeService();
+void bakePaletteChanged(int editedId);
+void handleBake();
 
 // ========== HTML前端 ==========
-const char* htmlPage = R"rawliteral(
+// 放在 flash（PROGMEM），由 streamBegin() 分段送出
+const char htmlPage[] PROGMEM = R"rawliteral(
 <!DOCTYPE html>
 <html lang="zh-TW">
 <head>
@@ -308,6 +985,8 @@ const char* htmlPage = R"rawliteral(
       <button class="lang-btn" onclick="setLanguage('zh-CN')">简体中文</button>
     </div>
         
+    <canvas id="preview" width="320" height="40" style="width: 100%; height: 40px; background: #111; border-radius: 8px; margin-bottom: 15px;"></canvas>
+
     <div class="mode-section">
       <div class="section-title" id="modeTitle">Animation Mode</div>
       <div id="modeButtons" class="button-group" style="min-height: 50px;"></div>
@@ -332,6 +1011,15 @@ const char* htmlPage = R"rawliteral(
       </div>
     </div>
     
+    <div id="programPanel" class="control-section" style="display:none;">
+      <div class="section-title" id="programTitle">Custom Effect</div>
+      <input type="text" id="programSrc" style="width: 100%; padding: 6px; border: 1px solid #ddd; border-radius: 4px; font-family: monospace; font-size: 12px;">
+      <div style="display: flex; gap: 10px; align-items: center; margin-top: 8px;">
+        <button class="action-btn" id="programApply" onclick="applyProgram()">Apply</button>
+        <span id="programStatus" style="font-size: 12px; color: #666;"></span>
+      </div>
+    </div>
+    
     <div class="control-section" style="border-top: 1px solid #ddd; padding-top: 20px;">
       <div style="display: flex; align-items: center; gap: 10px; margin-bottom: 10px; justify-content: space-between;">
         <label id="vibrationLabel" style="margin: 0; flex: 1; font-size: 13px; font-weight: bold;"><span id="vibrationText">Vibration Trigger (Auto Mode)</span></label>
@@ -349,7 +1037,7 @@ const char* htmlPage = R"rawliteral(
     var currentLang = 'en';
 
     // list of translation keys for each animation mode in order
-    var modeKeys = ['rainbowCycle','randomFlash','colorPulse','chase','cylon','fire','noise','pacifica','pride','twinkle','demoRainbow','demoGlitter','demoConfetti','demoSinelon','demoJuggle','demoBPM', 'mono', 'clearLEDs'];
+    var modeKeys = ['rainbowCycle','randomFlash','colorPulse','chase','cylon','fire','noise','pacifica','pride','twinkle','demoRainbow','demoGlitter','demoConfetti','demoSinelon','demoJuggle','demoBPM', 'mono', 'clearLEDs', 'custom'];
 
     // Multi-language translations
     var i18n = {
@@ -389,6 +1077,9 @@ const char* htmlPage = R"rawliteral(
         'demoSinelon': 'Sinelon',
         'demoJuggle': 'Juggle',
         'demoBPM': 'BPM',
+        'custom': 'Custom',
+        'programTitle': 'Custom Effect',
+        'apply': 'Apply',
         'close': 'Close'
       },
       'zh-TW': {
@@ -427,6 +1118,9 @@ const char* htmlPage = R"rawliteral(
         'demoSinelon': '單點來回',
         'demoJuggle': '交錯',
         'demoBPM': '節拍',
+        'custom': '自訂',
+        'programTitle': '自訂效果',
+        'apply': '套用',
         'close': '關閉'
       },
       'zh-CN': {
@@ -465,6 +1159,9 @@ const char* htmlPage = R"rawliteral(
         'demoSinelon': '單點往返',
         'demoJuggle': '抛球',
         'demoBPM': '节拍',
+        'custom': '自定义',
+        'programTitle': '自定义效果',
+        'apply': '应用',
         'close': '关闭'
       }
     };
@@ -499,6 +1196,8 @@ const char* htmlPage = R"rawliteral(
       document.getElementById('modeTitle').textContent = t('animationMode');
       document.getElementById('brightnessLabel').textContent = t('brightness');
       document.getElementById('colorTitle').textContent = t('colorTitle');
+      document.getElementById('programTitle').textContent = t('programTitle');
+      document.getElementById('programApply').textContent = t('apply');
       document.getElementById('vibrationText').textContent = t('vibrationTrigger') + ' (Auto Mode)';
 
       // rebuild/refresh mode buttons text
@@ -552,17 +1251,37 @@ const char* htmlPage = R"rawliteral(
             var btn = document.getElementById('modeBtn' + idx);
             if (btn) btn.classList.toggle('active', idx === mode);
           });
-          // Mono顯示顏色面板
-          var colorPanel = document.getElementById('colorPanel');
-          if (modeKeys[mode] === 'mono') {
-            colorPanel.style.display = '';
-          } else {
-            colorPanel.style.display = 'none';
-          }
+          updatePanels(mode);
         })
         .catch(function(e) { console.error('Error setting mode:', e); });
     }
     
+    // Mono顯示顏色面板，Custom顯示自訂效果面板
+    function updatePanels(mode) {
+      document.getElementById('colorPanel').style.display = modeKeys[mode] === 'mono' ? '' : 'none';
+      var programPanel = document.getElementById('programPanel');
+      var showProgram = modeKeys[mode] === 'custom';
+      if (showProgram && programPanel.style.display === 'none') loadProgram();
+      programPanel.style.display = showProgram ? '' : 'none';
+    }
+
+    function loadProgram() {
+      fetch('/api/program')
+        .then(function(r) { return r.json(); })
+        .then(function(data) { document.getElementById('programSrc').value = data.src; })
+        .catch(function(e) { console.log(e); });
+    }
+
+    function applyProgram() {
+      var src = document.getElementById('programSrc').value;
+      fetch('/api/setProgram?src=' + encodeURIComponent(src))
+        .then(function(r) { return r.json(); })
+        .then(function(data) {
+          document.getElementById('programStatus').textContent = data.error ? data.error + ' @' + data.pos : 'OK';
+        })
+        .catch(function(e) { console.log(e); });
+    }
+    
     function updateBrightness() {
       var val = document.getElementById('brightness').value;
       document.getElementById('brightnessValue').textContent = val;
@@ -598,18 +1317,80 @@ const char* htmlPage = R"rawliteral(
           buttons.forEach((btn, idx) => {
             btn.classList.toggle('active', idx === currentMode);
           });
-          // Mono顯示顏色面板
-          var colorPanel = document.getElementById('colorPanel');
-          if (modeKeys[currentMode] === 'mono') {
-            colorPanel.style.display = '';
-          } else {
-            colorPanel.style.display = 'none';
-          }
+          updatePanels(currentMode);
           // 震動開關同步
           updateAutoModeToggle(data.autoMode);
+          if (!previewLeds && data.leds) {
+            previewLeds = data.leds;
+            startPreview();
+          }
+        });
+    }
+
+    // LED 即時預覽：/api/preview 送來 [數量][索引 R G B]... 的差異訊息
+    var previewColors = [];
+    var previewLeds = 0;
+    var previewAbort = null;
+
+    function drawPreview() {
+      var canvas = document.getElementById('preview');
+      var ctx = canvas.getContext('2d');
+      var w = canvas.width / previewLeds;
+      ctx.fillStyle = '#111';
+      ctx.fillRect(0, 0, canvas.width, canvas.height);
+      for (var i = 0; i < previewLeds; i++) {
+        ctx.fillStyle = previewColors[i] || '#000';
+        ctx.beginPath();
+        ctx.arc(w * (i + 0.5), canvas.height / 2, Math.min(w, canvas.height) * 0.4, 0, 2 * Math.PI);
+        ctx.fill();
+      }
+    }
+
+    function startPreview() {
+      if (previewAbort || !previewLeds || !window.ReadableStream || !window.AbortController || document.hidden) return;
+      previewAbort = new AbortController();
+      previewColors = [];
+      drawPreview();
+      var pending = new Uint8Array(0);
+      fetch('/api/preview?fps=10', { signal: previewAbort.signal })
+        .then(function(r) {
+          if (!r.ok) throw new Error('preview ' + r.status);
+          var reader = r.body.getReader();
+          function pump() {
+            return reader.read().then(function(res) {
+              if (res.done) return;
+              var buf = new Uint8Array(pending.length + res.value.length);
+              buf.set(pending);
+              buf.set(res.value, pending.length);
+              var pos = 0;
+              while (pos < buf.length && buf.length - pos >= 1 + 4 * buf[pos]) {
+                for (var j = 0; j < buf[pos]; j++) {
+                  var o = pos + 1 + 4 * j;
+                  previewColors[buf[o]] = 'rgb(' + buf[o + 1] + ',' + buf[o + 2] + ',' + buf[o + 3] + ')';
+                }
+                pos += 1 + 4 * buf[pos];
+              }
+              pending = buf.slice(pos);
+              drawPreview();
+              return pump();
+            });
+          }
+          return pump();
+        })
+        .catch(function(e) { console.log(e); })
+        .then(function() {
+          // 串流結束或失敗：頁面仍可見時稍後重連
+          previewAbort = null;
+          setTimeout(startPreview, 3000);
         });
     }
 
+    // 頁面隱藏時關閉串流，玩具端沒有觀看者就不送資料
+    document.addEventListener('visibilitychange', function() {
+      if (document.hidden && previewAbort) previewAbort.abort();
+      else startPreview();
+    });
+
     // Color functions
     function hexToRgb(hex) {
       var result = /^#?([a-f\d]{2})([a-f\d]{2})([a-f\d]{2})$/i.exec(hex);
@@ -681,6 +1462,26 @@ void setup() {
   server.on("/api/setBrightness", handleSetBrightness);
   server.on("/api/setColor", handleSetColor);
   server.on("/api/toggleAuto", handleToggleAuto);
+  server.on("/api/playlist", handlePlaylist);
+  server.on("/api/setPreset", handleSetPreset);
+  server.on("/api/deletePreset", handleDeletePreset);
+  server.on("/api/togglePlaylist", handleTogglePlaylist);
+  server.on("/api/metrics", handleMetrics);
+  server.on("/api/setPowerBudget", handleSetPowerBudget);
+  server.on("/api/palettes", handlePalettes);
+  server.on("/api/setPalette", handleSetPalette);
+  server.on("/api/uploadPalette", handleUploadPalette);
+  server.on("/api/program", handleProgram);
+  server.on("/api/setProgram", handleSetProgram);
+  server.on("/api/update", HTTP_POST, handleUpdateDone, handleUpdateUpload);
+  server.on("/api/sync", handleSync);
+  server.on("/api/seed", handleSeed);
+  server.on("/api/bake", handleBake);
+  server.on("/api/idle", handleIdle);
+  server.on("/api/preview", handlePreview);
+#if TRACE_ENABLED
+  server.on("/api/trace", handleTrace);
+#endif
   server.begin();
   
   Serial.println("🚀 Web服務器已啟動");
@@ -689,42 +1490,124 @@ void setup() {
   Serial.println("/");
   Serial.println("===================================\n");
 
-  // LED初始化
-  FastLED.addLeds<CHIPSET, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS);
+  // LED初始化：亮度與抖動改由輸出級處理
+  FastLED.addLeds<CHIPSET, LED_PIN, COLOR_ORDER>(outLeds, NUM_LEDS);
   FastLED.setBrightness(255);
-  FastLED.setDither(BINARY_DITHER);
+  FastLED.setDither(DISABLE_DITHER);
   FastLED.clear();
   FastLED.show();
+  initOutput();
+#ifdef RNG_SEED
+  rngSeed(RNG_SEED);
+#else
+  rngSeed(ESP.random());
+#endif
+  powerUpdateVcc();
   
   // 震動感應器初始化
   pinMode(VIBRATION_PIN, INPUT);
   // 初始化閒置計時
   resetIdleTimer();
+
+  // 播放清單
+  if (!LittleFS.begin()) {
+    Serial.println("⚠️ LittleFS 掛載失敗，播放清單不會保存");
+  }
+  loadPalettes();
+  paletteSelect(activePalette, true);
+  loadProgram();
+  bakeScan();
+  loadPlaylist();
+  if (playlistEnabled) playlistApply(0);
+  loadSyncConfig();
+  syncStart();
+  loadIdleConfig();
 }
 
 void loop() {
+  unsigned long loopStart = micros();
+
   // 處理Web請求
-  server.handleClient();
+  uint32_t servedBefore = httpRequests;
+  {
+    TRACE_SCOPE_AS(httpTrace, TRACE_HTTP);
+    ALLOC_SCOPE(ALLOC_HTTP);
+    server.handleClient();
+    TRACE_KEEP(httpTrace, httpRequests != servedBefore);  // 空輪詢每 1ms 一次，記下來會把環形緩衝區洗掉
+  }
+#if ALLOC_TRACKING
+  allocEndRequest();
+#endif
+  // 等待下一幀時 loop() 每 1ms 輪詢一次；只把有做事的迴圈記入 loopHist，免得被空迴圈淹沒
+  bool worked = httpRequests != servedBefore;
+  if (worked) {
+    histObserve(httpHist, micros() - loopStart);
+  }
+  worked |= streamService();
+  worked |= previewService();
   
   // 檢測震動
   if (autoMode && digitalRead(VIBRATION_PIN) == HIGH) {
     unsigned long currentTime = millis();
     if (currentTime - lastVibrationTime > VIBRATION_THRESHOLD) {
+      vibrationEvents++;
       handleVibration();
       lastVibrationTime = currentTime;
     }
   }
   
-  // 更新動畫
-  updateAnimation();
-  
-  FastLED.show();
-  // 檢查是否閒置超時，進入深度睡眠
-  if (idleTimeout > 0 && (millis() - lastActivity) > idleTimeout) {
-    Serial.println("🔌 閒置超時，進入深度睡眠...");
-    enterDeepSleep();
+  // 多台同步：未啟用時不做任何事
+  if (syncRole != SYNC_OFF) {
+    syncService();
+  }
+
+  // 播放清單：兩次切換之間只做一次時間比較
+  if (playlistEnabled && (long)(millis() - playlistNextSwitch) >= 0) {
+    playlistAdvance();
+  }
+
+  // 更新動畫：效果以 frameIntervalMs 節奏渲染（閒置時放慢），落後整幀以上時計為漏幀並重新對齊
+  unsigned long now = millis();
+  if ((long)(now - nextFrameTime) >= 0) {
+    unsigned long late = now - nextFrameTime;
+    if (late >= frameIntervalMs) {
+      // 對齊到最近一格，已預先渲染的後續幀仍然有效
+      framesDropped += late / frameIntervalMs;
+      nextFrameTime += late / frameIntervalMs * frameIntervalMs;
+    }
+    uint32_t due = nextFrameTime;
+    nextFrameTime += frameIntervalMs;
+    renderPresentDue(due);
+    worked = true;
+  } else {
+    // 幀與幀之間：錄製中把累積的片段寫入 flash，否則預先渲染
+    worked |= bakeService();
+    worked |= renderAhead();
+  }
+
+  // 輸出級：有新資料或需要抖動時，以 OUTPUT_REFRESH_HZ 刷新燈帶；幀間休眠階段不做抖動
+  if ((outputDirty || (outputDithering && idleStage < IDLE_LIGHT)) && micros() - lastRefresh >= OUTPUT_REFRESH_US) {
+    outputRefresh();
+    worked = true;
+  }
+
+  if (millis() - lastVccCheck >= POWER_VCC_INTERVAL_MS) {
+    powerUpdateVcc();
+  }
+
+  // 依閒置時間切換省電階段，超時則進入深度睡眠
+  idleService();
+  handleSerialCommand();
+  if (worked) {
+    histObserve(loopHist, micros() - loopStart);
   }
-  delay(30);
+  // delay() 讓出 CPU 給 SDK；幀間休眠階段睡久一點，但不超過下一幀
+  unsigned long wait = 1;
+  if (idleStage >= IDLE_LIGHT) {
+    long untilFrame = (long)(nextFrameTime - millis());
+    wait = constrain(untilFrame, 1, IDLE_LIGHT_DELAY_MS);
+  }
+  delay(wait);
 }
 
 void initWiFi() {
@@ -767,76 +1650,98 @@ void initWiFi() {
 }
 
 void handleRoot() {
-  resetIdleTimer();
-  server.send(200, "text/html; charset=utf-8", htmlPage);
+  beginRequest();
+  streamBegin("text/html; charset=utf-8", htmlPage, sizeof(htmlPage) - 1);
+}
+
+// 送出 JSON 回應。server 組標頭時的配置與解析請求一樣記到 ALLOC_HTTP，不算在 handler 頭上
+static void sendJson(int code, const char* json) {
+  ALLOC_SCOPE(ALLOC_HTTP);
+  server.send_P(code, PSTR("application/json"), json, strlen(json));
+}
+
+// 小型 JSON 回應：格式化到堆疊上的緩衝區再送出，/api/status 與各設定 handler 因此不配置記憶體
+static void sendJsonf(int code, PGM_P fmt, ...) {
+  char buf[128];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf_P(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  sendJson(code, buf);
 }
 
 void handleAPI() {
-  resetIdleTimer();
-  String response = "{\"status\":\"ok\",\"mode\":" + String(animationMode) + ",\"autoMode\":" + String(autoMode ? "true" : "false") + "}";
-  server.send(200, "application/json", response);
+  beginRequest();
+  sendJsonf(200, PSTR("{\"status\":\"ok\",\"mode\":%d,\"autoMode\":%s,\"palette\":%u,\"leds\":%u}"),
+            animationMode, autoMode ? "true" : "false", activePalette, NUM_LEDS);
 }
 
 void handleSetMode() {
-  resetIdleTimer();
+  beginRequest();
   if (server.hasArg("mode")) {
     int mode = server.arg("mode").toInt();
+    if (playlistEnabled) {
+      playlistEnabled = false;  // 手動選擇模式時暫停播放清單，並寫回避免重開機後又恢復
+      savePlaylist();
+    }
     setAnimationMode(mode);
-    server.send(200, "application/json", "{\"status\":\"ok\"}");
+    sendJson(200, "{\"status\":\"ok\"}");
   } else {
-    server.send(400, "application/json", "{\"error\":\"缺少參數\"}" );
+    sendJson(400, "{\"error\":\"缺少參數\"}");
   }
 }
 
 void handleSetBrightness() {
-  resetIdleTimer();
+  beginRequest();
   if (server.hasArg("value")) {
     int brightness = server.arg("value").toInt();
     // 範圍校驗：0-255
     if (brightness < 0) brightness = 0;
     if (brightness > 255) brightness = 255;
-    FastLED.setBrightness(brightness);
-    //FastLED.show();
+    ledBrightness = brightness;
     Serial.print("💡 亮度設置: ");
     Serial.println(brightness);
-    server.send(200, "application/json", "{\"status\":\"ok\",\"brightness\":" + String(brightness) + "}");
+    sendJsonf(200, PSTR("{\"status\":\"ok\",\"brightness\":%d}"), brightness);
   } else {
-    server.send(400, "application/json", "{\"error\":\"missing value parameter\"}");
+    sendJson(400, "{\"error\":\"missing value parameter\"}");
   }
 }
 
 void handleSetColor() {
-  resetIdleTimer();
+  beginRequest();
   if (server.hasArg("r") && server.hasArg("g") && server.hasArg("b")) {
     int r = constrain(server.arg("r").toInt(), 0, 255);
     int g = constrain(server.arg("g").toInt(), 0, 255);
     int b = constrain(server.arg("b").toInt(), 0, 255);
     monoColor = CRGB(r, g, b);
+    if (animationMode == MODE_MONO) renderAheadFlush();
     Serial.print("🎨 顏色設置 RGB(");
     Serial.print(r); Serial.print(",");
     Serial.print(g); Serial.print(",");
     Serial.print(b); Serial.println(")");
-    server.send(200, "application/json", "{\"status\":\"ok\",\"color\":\"rgb(" + String(r) + "," + String(g) + "," + String(b) + ")\"}");
+    sendJsonf(200, PSTR("{\"status\":\"ok\",\"color\":\"rgb(%d,%d,%d)\"}"), r, g, b);
   } else {
-    server.send(400, "application/json", "{\"error\":\"missing color parameters\"}");
+    sendJson(400, "{\"error\":\"missing color parameters\"}");
   }
 }
 
 void handleToggleAuto() {
-  resetIdleTimer();
+  beginRequest();
   autoMode = !autoMode;
   Serial.print("🔄 自動模式: ");
   Serial.println(autoMode ? "啟用" : "禁用");
-  server.send(200, "application/json", "{\"status\":\"ok\",\"autoMode\":" + String(autoMode ? "true" : "false") + "}");
+  sendJsonf(200, PSTR("{\"status\":\"ok\",\"autoMode\":%s}"), autoMode ? "true" : "false");
 }
 
 void setAnimationMode(int mode) {
+  ALLOC_SCOPE(ALLOC_MODE);
   animationMode = mode;
+  renderAheadFlush();
   animationTimer = millis();
   // 重設色彩相關變數
   currentColorIndex = 0;
-  currentAnimColor = breathingColors[0];
-  nextAnimColor = breathingColors[1];
+  currentAnimColor = breathingColor(0);
+  nextAnimColor = breathingColor(1);
   breathingCycleCount = 0;
   colorTransitionFrames = 0;
   
@@ -861,18 +1766,27 @@ void setAnimationMode(int mode) {
     case MODE_DEMO_BPM: Serial.println("BPM"); break;
     case MODE_MONO: Serial.println("單色"); break;
     case MODE_CLEARLED: Serial.println("清空LED"); break;
+    case MODE_CUSTOM: Serial.println("自訂效果"); break;
     default: Serial.println("未知模式");
   }
 }
 
 void handleVibration() {
+  TRACE_SCOPE(TRACE_VIBRATION);
   resetIdleTimer();
   Serial.println("✨ 偵測到震動！");
+  if (playlistEnabled) {
+    playlistAdvance();
+    return;
+  }
   animationMode = (animationMode + 1) % MODE_COUNT;
   animationTimer = millis();
 }
 
 void updateAnimation() {
+  TRACE_SCOPE(TRACE_ANIMATION);
+  // demo 色相隨效果時間前進（每幀 +1），多台同步時相位一致
+  demoHue = effectMillis() / FRAME_INTERVAL_MS;
   switch(animationMode) {
     case MODE_RAINBOW:
       rainbowCycle(255);
@@ -887,70 +1801,203 @@ void updateAnimation() {
       chaseAnimation();
       break;
     case MODE_CYLON:
-      cylon.draw(fl::Fx::DrawContext(millis(), leds));
+      cylon.draw(fl::Fx::DrawContext(effectMillis(), leds));
       break;
     case MODE_FIRE:
-      fire2012.draw(fl::Fx::DrawContext(millis(), leds));
+      fire2012.draw(fl::Fx::DrawContext(effectMillis(), leds));
       break;
     case MODE_NOISE:
-      noiseWave.draw(fl::Fx::DrawContext(millis(), leds));
+      noiseWave.draw(fl::Fx::DrawContext(effectMillis(), leds));
       break;
     case MODE_PACIFICA:
-      pacifica.draw(fl::Fx::DrawContext(millis(), leds));
+      pacifica.draw(fl::Fx::DrawContext(effectMillis(), leds));
       break;
     case MODE_PRIDE:
-      pride2015.draw(fl::Fx::DrawContext(millis(), leds));
+      pride2015.draw(fl::Fx::DrawContext(effectMillis(), leds));
       break;
     case MODE_TWINKLE:
-      twinklefox.draw(fl::Fx::DrawContext(millis(), leds));
+      twinklefox.draw(fl::Fx::DrawContext(effectMillis(), leds));
       break;
     case MODE_DEMO_RAINBOW:
-      demoHue++;
       demoRainbow();
       break;
     case MODE_DEMO_GLITTER:
-      demoHue++;
       demoRainbowGlitter();
       break;
     case MODE_DEMO_CONFETTI:
-      demoHue++;
       demoConfetti();
       break;
     case MODE_DEMO_SINELON:
-      demoHue++;
       demoSinelon();
       break;
     case MODE_DEMO_JUGGLE:
-      demoHue++;
       demoJuggle();
       break;
     case MODE_DEMO_BPM:
-      demoHue++;
       demoBpm();
       break;
     case MODE_MONO:
-      for (int i = 0; i < NUM_LEDS; i++) leds[i] = monoColor;
+      Strip::fill(leds, monoColor);
+      break;
+    case MODE_CUSTOM:
+      vmRender();
       break;
     default:
       // unknown mode, just clear
-      FastLED.clear();
+      fill_solid(leds, NUM_LEDS, CRGB::Black);
       break;
   }
 }
 
-void rainbowCycle(uint8_t brightness) {
-  static uint8_t hue = 0;
-  hue += 3;
-  
-  for (int i = 0; i < NUM_LEDS; i++) {
-    leds[i] = CHSV((hue + i * 255 / NUM_LEDS), 255, brightness);
+// 每 renderDivisor 幀渲染一次效果，其餘幀回傳兩個關鍵幀的混合。
+// 輸出比渲染落後不到一個關鍵幀；切換模式時從舊畫面淡入新模式
+const CRGB* interpRender() {
+  uint8_t n = animationMode >= 0 && animationMode < MODE_COUNT ? pgm_read_byte(&renderDivisor[animationMode]) : 1;
+  if (animationMode != interpMode) {
+    interpMode = animationMode;
+    interpStep = 0;
+  }
+  if (interpStep == 0) {
+    memcpy(keyPrev, (const CRGB*)leds, sizeof(keyPrev));
+    updateAnimation();
   }
+  if (++interpStep >= n) {
+    interpStep = 0;
+    return leds;
+  }
+  blend(keyPrev, leds, interpOut, NUM_LEDS, (uint16_t)interpStep * 256 / n);
+  return interpOut;
 }
 
-void randomFlash() {
-  for (int i = 0; i < NUM_LEDS; i++) {
-    leds[i] = CRGB(random(255), random(255), random(255));
+// 渲染一幀效果並交給輸出級
+// 以 due 作為效果時間渲染一幀到 f
+static void renderInto(QueuedFrame& f, uint32_t due) {
+#if ALLOC_TRACKING
+  static int lastMode = -1;
+  uint32_t allocsBefore = allocStats[ALLOC_FRAME].allocs;
+#endif
+  f.mode = animationMode;
+  f.due = due;
+  renderCursor = due + frameIntervalMs;
+  {
+    ALLOC_SCOPE(ALLOC_FRAME);
+    renderLead = due - millis();
+    paletteTick();
+    unsigned long t0 = micros();
+    const CRGB* frame = leds;
+    if (!bakeRender(leds)) frame = interpRender();
+    f.renderUs = micros() - t0;
+    renderLead = 0;
+    memcpy(f.px, frame, sizeof(f.px));
+  }
+#if ALLOC_TRACKING
+  // 切換模式後的第一幀可能開檔 / 初始化，不算穩定狀態
+  if (allocStats[ALLOC_FRAME].allocs != allocsBefore && animationMode == lastMode &&
+      framesRendered > ALLOC_WARMUP_FRAMES) {
+    char msg[48];
+    snprintf_P(msg, sizeof(msg), PSTR("幀內配置記憶體: 模式 %d"), animationMode);
+    allocViolation(allocFrameViolations, msg, allocStats[ALLOC_FRAME].lastCaller);
+  }
+  lastMode = animationMode;
+#endif
+}
+
+// 把渲染好的幀交給輸出級
+static void presentFrame(const QueuedFrame& f) {
+  {
+    ALLOC_SCOPE(ALLOC_FRAME);
+    outputLoad(f.px);
+  }
+  histObserve(animHist, f.renderUs);
+  if (bakeState == BAKE_RECORDING) bakeRecordFrame(f.px);
+  memcpy(displayFrame, f.px, sizeof(displayFrame));
+  framesRendered++;
+  // 只統計全速運作的幀，省電階段的幀率與亮度不同
+  if (idleStage == IDLE_ACTIVE && f.mode >= 0 && f.mode < MODE_COUNT) {
+    ModeStats& m = modeStats[f.mode];
+    m.frames++;
+    m.renderUs += f.renderUs;
+    m.ledMaFrames += powerEstimateMa;
+  }
+}
+
+// 直接讀 millis() 計時的效果（呼吸燈、跑馬燈），以及內部以預設 timebase 呼叫 beatsin 的
+// FastLED 效果（Pacifica、Pride2015 會混用 DrawContext 的時間與 millis()）在預先渲染時會走錯速度
+static bool renderAheadAllowed() {
+  return animationMode != MODE_BREATH && animationMode != MODE_CHASE && animationMode != MODE_PACIFICA &&
+         animationMode != MODE_PRIDE && bakeState != BAKE_RECORDING;
+}
+
+// 下一幀的效果時間：從 due 起算的幀格上，第一個不早於已渲染到的時間的那一格
+static uint32_t renderNextDue(uint32_t due) {
+  int32_t ahead = renderCursor - due;
+  if (ahead <= 0) return due;
+  return due + (ahead + frameIntervalMs - 1) / frameIntervalMs * frameIntervalMs;
+}
+
+// 模式、顏色、調色盤、程式或幀率改變時丟棄已渲染的幀；亮度在輸出級套用，不需重新渲染。
+// renderCursor 退回下一格：同一輪 loop() 接著就以新設定渲染 nextFrameTime 那一格（到時間就直接
+// 顯示），不再保留舊畫面等顯示時間追上已渲染到的時間。會預先渲染的效果都以效果時間或幀數計算，
+// 效果時間小幅倒退沒有影響
+void renderAheadFlush() {
+  renderQueueCount = 0;
+  renderCursor = nextFrameTime;
+}
+
+// loop() 空檔時呼叫：佇列未滿就多渲染一幀
+bool renderAhead() {
+  if (renderQueueCount == RENDER_AHEAD_FRAMES || !renderAheadAllowed()) return false;
+  uint32_t due = renderNextDue(nextFrameTime);
+  renderInto(renderQueue[(renderQueueHead + renderQueueCount) & (RENDER_AHEAD_FRAMES - 1)], due);
+  renderQueueCount++;
+  return true;
+}
+
+// 顯示 due 這一格：佇列中有對應的幀就直接取出，否則當場渲染
+void renderPresentDue(uint32_t due) {
+  // 丟掉過期（漏幀）或模式已變的幀
+  while (renderQueueCount) {
+    const QueuedFrame& head = renderQueue[renderQueueHead];
+    if (head.mode == animationMode && (int32_t)(head.due - due) >= 0) break;
+    renderQueueHead = (renderQueueHead + 1) & (RENDER_AHEAD_FRAMES - 1);
+    renderQueueCount--;
+  }
+  if (renderQueueCount && renderQueue[renderQueueHead].due == due) {
+    renderQueueDepthPops[renderQueueCount]++;
+    presentFrame(renderQueue[renderQueueHead]);
+    renderQueueHead = (renderQueueHead + 1) & (RENDER_AHEAD_FRAMES - 1);
+    renderQueueCount--;
+    return;
+  }
+  // 佇列中的幀不經 renderAheadFlush() 被丟掉、效果已渲染到 due 之後：保留目前畫面，
+  // 等顯示時間追上（最多 RENDER_AHEAD_FRAMES 幀）
+  if ((int32_t)(renderCursor - due) > 0) {
+    renderHolds++;
+    return;
   }
+  renderAheadFlush();
+  if (renderAheadAllowed()) renderUnderruns++;
+  renderQueueDepthPops[0]++;
+  static QueuedFrame immediate;
+  renderInto(immediate, due);
+  presentFrame(immediate);
+}
+
+// 立即渲染並送出一幀（OTA 上傳期間等不經過排程的地方）
+void renderFrame() {
+  renderAheadFlush();
+  static QueuedFrame immediate;
+  renderInto(immediate, renderNextDue(millis()));
+  presentFrame(immediate);
+}
+
+void rainbowCycle(uint8_t brightness) {
+  uint8_t hue = effectMillis() / 10;  // 每 30ms 幀 +3
+  Strip::rainbowCycle(leds, hue, brightness);
+}
+
+void randomFlash() {
+  rngFill((uint8_t*)(CRGB*)leds, NUM_LEDS * sizeof(CRGB));
 }
 
 void chaseAnimation() {
@@ -972,7 +2019,7 @@ void chaseAnimation() {
       // 每 3 圈開始色彩過渡
       if (breathingCycleCount >= colorSwitchCycles && colorTransitionFrames == 0) {
         int nextIdx = (currentColorIndex + 1) % numBreathingColors;
-        nextAnimColor = breathingColors[nextIdx];
+        nextAnimColor = breathingColor(nextIdx);
         colorTransitionFrames = 1;  // 開始過渡
         breathingCycleCount = 0;
       }
@@ -980,9 +2027,7 @@ void chaseAnimation() {
   }
   
   // 清空所有LED
-  for (int i = 0; i < NUM_LEDS; i++) {
-    leds[i] = CRGB::Black;
-  }
+  Strip::fill(leds, CRGB::Black);
   
   // 計算當前顯示色彩（支援漸層過渡）
   CRGB chaseColor = currentAnimColor;
@@ -1009,12 +2054,12 @@ void chaseAnimation() {
 // --- demo pattern implementations ---
 
 void demoRainbow() {
-  fill_rainbow(leds, NUM_LEDS, demoHue, 7);
+  Strip::rainbow<7>(leds, demoHue);
 }
 
 void addDemoGlitter(uint8_t chance) {
-  if (random8() < chance) {
-    leds[random16(NUM_LEDS)] += CRGB::White;
+  if (rng8() < chance) {
+    leds[rngBelow(NUM_LEDS)] += CRGB::White;
   }
 }
 
@@ -1024,33 +2069,30 @@ void demoRainbowGlitter() {
 }
 
 void demoConfetti() {
-  fadeToBlackBy(leds, NUM_LEDS, 10);
-  int pos = random16(NUM_LEDS);
-  leds[pos] += CHSV(demoHue + random8(64), 200, 255);
+  Strip::fade(leds, 10);
+  int pos = rngBelow(NUM_LEDS);
+  leds[pos] += CHSV(demoHue + (rng8() >> 2), 200, 255);
 }
 
 void demoSinelon() {
-  fadeToBlackBy(leds, NUM_LEDS, 20);
-  int pos = beatsin16(13, 0, NUM_LEDS - 1);
+  Strip::fade(leds, 20);
+  int pos = beatsin16(13, 0, Strip::last, syncTimebase());
   leds[pos] += CHSV(demoHue, 255, 192);
 }
 
 void demoJuggle() {
-  fadeToBlackBy(leds, NUM_LEDS, 20);
+  Strip::fade(leds, 20);
   uint8_t dothue = 0;
   for (uint8_t i = 0; i < 8; i++) {
-    leds[beatsin16(i + 7, 0, NUM_LEDS - 1)] |= CHSV(dothue, 200, 255);
+    leds[beatsin16(i + 7, 0, Strip::last, syncTimebase())] |= CHSV(dothue, 200, 255);
     dothue += 32;
   }
 }
 
 void demoBpm() {
   uint8_t BeatsPerMinute = 62;
-  CRGBPalette16 palette = PartyColors_p;
-  uint8_t beat = beatsin8(BeatsPerMinute, 64, 255);
-  for (uint16_t i = 0; i < NUM_LEDS; i++) {
-    leds[i] = ColorFromPalette(palette, demoHue + (i * 2), beat - demoHue + (i * 10));
-  }
+  uint8_t beat = beatsin8(BeatsPerMinute, 64, 255, syncTimebase());
+  Strip::bpm(leds, paletteLut, demoHue, beat);
 }
 
 // 呼吸燈模式：平滑呼吸，每 3 個循環平滑漸層換色
@@ -1059,10 +2101,13 @@ void breathingLight() {
   static unsigned long lastUpdate = 0;
   unsigned long now = millis();
   
-  // 每 50ms 更新一次呼吸亮度
-  if (now - lastUpdate > 50) {
+  // 依經過時間每 60ms 前進一步（即原本 30ms 幀率下的速度），
+  // 閒置降幀率或 renderDivisor 拉長關鍵幀間隔時一次補上多步，呼吸速度不變
+  unsigned long steps = (now - lastUpdate) / BREATH_STEP_MS;
+  if (steps > 64) steps = 64;  // 長時間沒渲染（例如切回此模式）時不必補完
+  lastUpdate = steps == 64 ? now : lastUpdate + steps * BREATH_STEP_MS;
+  for (; steps > 0; steps--) {
     breathValue += 4;  // 控制呼吸速度，數值越小越慢
-    lastUpdate = now;
     
     // 偵測呼吸循環完成（breathValue 從 0 回到接近 0）
     if (breathValue % 256 < 4) {
@@ -1071,7 +2116,7 @@ void breathingLight() {
       // 每 3 個循環開始色彩過渡
       if (breathingCycleCount >= colorSwitchCycles && colorTransitionFrames == 0) {
         int nextIdx = (currentColorIndex + 1) % numBreathingColors;
-        nextAnimColor = breathingColors[nextIdx];
+        nextAnimColor = breathingColor(nextIdx);
         colorTransitionFrames = 1;  // 開始過渡
         breathingCycleCount = 0;
       }
@@ -1098,30 +2143,2145 @@ void breathingLight() {
   
   // 利用 sin8 產生平滑呼吸曲線（0-255-0）
   uint8_t fade = sin8(breathValue);
-  
-  for (int i = 0; i < NUM_LEDS; i++) {
-    leds[i] = displayColor;
-    leds[i].nscale8(fade);
+  displayColor.nscale8(fade);
+  Strip::fill(leds, displayColor);
+}
+
+// ========== 分段回應 ==========
+
+// 把目前請求的連線從 server 取出並送出 chunked 回應標頭，之後由呼叫端自行送 body
+static void streamDetach(WiFiClient& client, const char* contentType) {
+  client = server.client();
+  server.client() = WiFiClient();  // 分離：handleClient() 不再等待或關閉這個連線
+  client.setSync(false);           // write() 只複製到 TCP 緩衝區，不等 ACK
+  client.setNoDelay(true);
+  client.print(String("HTTP/1.1 200 OK\r\nContent-Type: ") + contentType +
+               "\r\nCache-Control: no-store\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+}
+
+// 取一個空的串流槽並把目前請求的連線交給它；全部佔用時回 503
+static ResponseStream* streamOpen(const char* contentType) {
+  ResponseStream* s = nullptr;
+  for (uint8_t i = 0; i < STREAM_SLOTS; i++) {
+    if (!streams[i].active) {
+      s = &streams[i];
+      break;
+    }
   }
+  if (!s) {
+    server.send(503, "application/json", "{\"error\":\"busy\"}");
+    return nullptr;
+  }
+  streamDetach(s->client, contentType);
+  s->pos = 0;
+  s->lastProgress = millis();
+  s->active = true;
+  return s;
 }
 
-// 色彩插值函數：平滑過渡從 from 色到 to 色
-// t: 當前進度（0 ~ max_t），max_t: 最大進度
-CRGB lerpColor(CRGB from, CRGB to, uint16_t t, uint16_t max_t) {
-  if (t >= max_t) return to;
-  if (t <= 0) return from;
-  
-  uint16_t ratio = (t * 256) / max_t;  // 0~256，256 表示 100% 到達目標色
-  uint8_t r = (from.r * (256 - ratio) + to.r * ratio) / 256;
-  uint8_t g = (from.g * (256 - ratio) + to.g * ratio) / 256;
-  uint8_t b = (from.b * (256 - ratio) + to.b * ratio) / 256;
-  
-  return CRGB(r, g, b);
+// 把目前請求的連線從 server 取出，之後由 streamService() 分段送完 body
+bool streamBegin(const char* contentType, PGM_P body, size_t len) {
+  ResponseStream* s = streamOpen(contentType);
+  if (!s) return false;
+  s->body = body;
+  s->len = len;
+  s->step = nullptr;
+  return true;
 }
 
-// 重設閒置計時（有使用者互動時呼叫）
-void resetIdleTimer() {
-  lastActivity = millis();
+// 同上，但 body 由 step() 在送出時才逐段產生，長度事先未知
+bool streamBeginSteps(const char* contentType, StreamStep step) {
+  ResponseStream* s = streamOpen(contentType);
+  if (!s) return false;
+  s->body = nullptr;
+  s->len = SIZE_MAX;  // step() 回傳 false 時改為 pos，之後送出結尾區塊
+  s->step = step;
+  return true;
+}
+
+// 把 Print 輸出寫進固定大小的緩衝區，放不下的部分捨棄
+class BufferPrint : public Print {
+ public:
+  BufferPrint(uint8_t* buf, size_t cap) : buf(buf), cap(cap) {}
+  size_t write(uint8_t c) override {
+    if (len == cap) return 0;
+    buf[len++] = c;
+    return 1;
+  }
+  size_t len = 0;
+ private:
+  uint8_t* buf;
+  size_t cap;
+};
+
+bool streamService() {
+  unsigned long start = micros();
+  bool wrote = false;
+  for (uint8_t i = 0; i < STREAM_SLOTS; i++) {
+    ResponseStream& s = streams[i];
+    if (!s.active) continue;
+    if (!s.client.connected() || millis() - s.lastProgress > STREAM_TIMEOUT_MS) {
+      s.client = WiFiClient();
+      s.active = false;
+      continue;
+    }
+    while (micros() - start < STREAM_BUDGET_US) {
+      // 只寫入送出視窗容得下的量（含 chunk 標頭 "XXX\r\n" 與結尾 "\r\n"），避免 write() 阻塞
+      int room = s.client.availableForWrite() - 7;
+      if (room <= 0) break;
+      if (s.pos == s.len) {
+        s.client.write((const uint8_t*)"0\r\n\r\n", 5);
+        // 放掉參照即關閉連線：lwIP 送完緩衝區後再送 FIN；stop() 會等待 flush 而阻塞
+        s.client = WiFiClient();
+        s.active = false;
+        break;
+      }
+      // 整個 chunk 組成一塊再寫一次：setNoDelay 下每次 write() 都會各自送出一個 TCP 分段。
+      // 內容放在 chunk + 5，長度確定後再把標頭接在它前面
+      static uint8_t chunk[5 + STREAM_CHUNK + 2];
+      uint8_t* data = chunk + 5;
+      size_t n;
+      if (s.step) {
+        // 逐段產生，直到下一段可能放不下；視窗連一段都放不下時等對方確認
+        size_t cap = min((size_t)room, (size_t)STREAM_CHUNK);
+        if (cap < STREAM_STEP_MAX) break;
+        BufferPrint out(data, cap);
+        while (out.len + STREAM_STEP_MAX <= cap) {
+          if (!s.step(out, s.pos)) {
+            s.len = s.pos;
+            break;
+          }
+          s.pos++;
+        }
+        n = out.len;
+        if (n == 0) continue;  // 剩下的段都沒有輸出：下一輪送結尾區塊
+      } else {
+        n = s.len - s.pos;
+        if (n > STREAM_CHUNK) n = STREAM_CHUNK;
+        if (n > (size_t)room) n = room;
+        memcpy_P(data, s.body + s.pos, n);
+        s.pos += n;
+      }
+      char head[6];
+      int headLen = snprintf(head, sizeof(head), "%X\r\n", (unsigned)n);
+      memcpy(data - headLen, head, headLen);
+      memcpy(data + n, "\r\n", 2);
+      s.client.write(data - headLen, headLen + n + 2);
+      s.lastProgress = millis();
+      wrote = true;
+    }
+  }
+  return wrote;
+}
+
+// ========== LED 即時預覽 ==========
+
+// /api/preview?fps=N 開始串流，N 為每秒最多送出的訊息數
+void handlePreview() {
+  beginRequest();
+  PreviewClient* p = nullptr;
+  for (uint8_t i = 0; i < PREVIEW_SLOTS; i++) {
+    if (!previews[i].active) {
+      p = &previews[i];
+      break;
+    }
+  }
+  if (!p) {
+    server.send(503, "application/json", "{\"error\":\"busy\"}");
+    return;
+  }
+  int fps = server.hasArg("fps") ? constrain(server.arg("fps").toInt(), 1, PREVIEW_FPS_MAX) : PREVIEW_FPS_DEFAULT;
+  streamDetach(p->client, "application/octet-stream");
+  fill_solid(p->sent, NUM_LEDS, CRGB::Black);
+  p->intervalMs = 1000 / fps;
+  p->lastSend = millis() - p->intervalMs;
+  p->lastProgress = millis();
+  p->active = true;
+  previewCount++;
+}
+
+bool previewService() {
+  if (previewCount == 0) return false;
+  unsigned long now = millis();
+  bool wrote = false;
+  for (uint8_t i = 0; i < PREVIEW_SLOTS; i++) {
+    PreviewClient& p = previews[i];
+    if (!p.active) continue;
+    if (!p.client.connected() || now - p.lastProgress > PREVIEW_TIMEOUT_MS) {
+      p.client = WiFiClient();
+      p.active = false;
+      previewCount--;
+      continue;
+    }
+    if (now - p.lastSend < p.intervalMs) continue;
+    p.lastSend = now;
+
+    // 訊息組在 buf 中間，前面留給 chunk 標頭，整個 chunk 一次寫出（setNoDelay 下每次 write 一個分段）
+    uint8_t buf[5 + 1 + NUM_LEDS * 4 + 2];
+    uint8_t* msg = buf + 5;
+    uint16_t len = 1;
+    for (uint8_t k = 0; k < NUM_LEDS; k++) {
+      if (displayFrame[k] == p.sent[k]) continue;
+      msg[len++] = k;
+      msg[len++] = displayFrame[k].r;
+      msg[len++] = displayFrame[k].g;
+      msg[len++] = displayFrame[k].b;
+    }
+    if (len == 1) {
+      p.lastProgress = now;
+      continue;
+    }
+    // 送出視窗不夠就跳過這次；sent 未更新，下次仍以瀏覽器實際顯示的內容做差異
+    if (p.client.availableForWrite() < len + 7) continue;
+    msg[0] = (len - 1) / 4;
+    char head[6];
+    int headLen = snprintf(head, sizeof(head), "%X\r\n", (unsigned)len);
+    uint8_t* chunk = msg - headLen;
+    memcpy(chunk, head, headLen);
+    memcpy(msg + len, "\r\n", 2);
+    p.client.write(chunk, headLen + len + 2);
+    p.lastProgress = now;
+    for (uint16_t j = 1; j < len; j += 4) {
+      p.sent[msg[j]] = CRGB(msg[j + 1], msg[j + 2], msg[j + 3]);
+    }
+    wrote = true;
+  }
+  return wrote;
+}
+
+// ========== 調色盤 ==========
+
+// 重建查表區段 k（索引 16k..16k+15）：項目 k 到項目 k+1 的線性插值，15 之後回到 0
+static void paletteBuildSegment(uint8_t k) {
+  const CRGB& a = paletteCurrent[k];
+  const CRGB& b = paletteCurrent[(k + 1) & 15];
+  CRGB* out = &paletteLut[k << 4];
+  for (uint8_t j = 0; j < 16; j++) {
+    out[j] = CRGB(a.r + (((b.r - a.r) * j) >> 4),
+                  a.g + (((b.g - a.g) * j) >> 4),
+                  a.b + (((b.b - a.b) * j) >> 4));
+  }
+}
+
+// 選擇調色盤；immediate 為 false 時由 paletteTick() 逐幀混合過去
+void paletteSelect(uint8_t id, bool immediate) {
+  if (id >= PALETTE_COUNT) id = 0;
+  activePalette = id;
+  renderAheadFlush();
+  bakePaletteChanged(-1);
+  if (id < PALETTE_BUILTIN_COUNT) {
+    const uint32_t* src = *builtinPalettes[id];
+    for (uint8_t i = 0; i < 16; i++) paletteTarget[i] = CRGB(pgm_read_dword(&src[i]));
+  } else {
+    memcpy(paletteTarget, userPalettes[id - PALETTE_BUILTIN_COUNT], sizeof(paletteTarget));
+  }
+  if (immediate) {
+    memcpy(paletteCurrent, paletteTarget, sizeof(paletteCurrent));
+    for (uint8_t k = 0; k < 16; k++) paletteBuildSegment(k);
+    paletteBlendPending = 0;
+  } else {
+    paletteBlendPending = 0xFFFF;
+  }
+}
+
+// 每個渲染幀呼叫：最多推進 PALETTE_BLEND_ENTRIES 個項目，每個通道走剩餘距離的 1/4
+void paletteTick() {
+  if (!paletteBlendPending) return;
+  uint16_t touched = 0;
+  for (uint8_t n = 0; n < PALETTE_BLEND_ENTRIES && paletteBlendPending; ) {
+    uint8_t i = paletteBlendCursor;
+    paletteBlendCursor = (paletteBlendCursor + 1) & 15;
+    if (!(paletteBlendPending & (1 << i))) continue;
+    CRGB& cur = paletteCurrent[i];
+    const CRGB& dst = paletteTarget[i];
+    for (uint8_t c = 0; c < 3; c++) {
+      int d = dst[c] - cur[c];
+      if (d) cur[c] += d / 4 + (d > 0 ? 1 : -1);
+    }
+    if (cur == dst) paletteBlendPending &= ~(1 << i);
+    touched |= 1 << i;
+    n++;
+  }
+  // 項目 i 影響區段 i-1 與 i
+  uint16_t segments = touched | (touched >> 1) | (touched << 15);
+  for (uint8_t k = 0; k < 16; k++) {
+    if (segments & (1 << k)) paletteBuildSegment(k);
+  }
+}
+
+void loadPalettes() {
+  File f = LittleFS.open(PALETTES_FILE, "r");
+  if (!f) return;
+  uint16_t magic = 0;
+  if (f.read((uint8_t*)&magic, sizeof(magic)) == sizeof(magic) && magic == PALETTES_MAGIC) {
+    f.read((uint8_t*)userPalettes, sizeof(userPalettes));
+  }
+  f.close();
+}
+
+void savePalettes() {
+  File f = LittleFS.open(PALETTES_FILE, "w");
+  if (!f) {
+    Serial.println("⚠️ 無法寫入調色盤");
+    return;
+  }
+  uint16_t magic = PALETTES_MAGIC;
+  f.write((const uint8_t*)&magic, sizeof(magic));
+  f.write((const uint8_t*)userPalettes, sizeof(userPalettes));
+  f.close();
+}
+
+void handlePalettes() {
+  beginRequest();
+  String response = "{\"status\":\"ok\",\"active\":" + String(activePalette) + ",\"palettes\":[";
+  for (uint8_t id = 0; id < PALETTE_COUNT; id++) {
+    if (id > 0) response += ",";
+    response += "{\"id\":" + String(id) + ",\"name\":\"";
+    response += id < PALETTE_BUILTIN_COUNT ? String(builtinPaletteNames[id]) : "user" + String(id - PALETTE_BUILTIN_COUNT);
+    response += "\"}";
+  }
+  response += "]}";
+  server.send(200, "application/json", response);
+}
+
+void handleSetPalette() {
+  beginRequest();
+  if (server.hasArg("id")) {
+    int id = server.arg("id").toInt();
+    if (id < 0 || id >= (int)PALETTE_COUNT) {
+      sendJson(400, "{\"error\":\"id out of range\"}");
+      return;
+    }
+    paletteSelect(id, false);
+    Serial.print("🎨 調色盤: ");
+    Serial.println(id);
+    sendJsonf(200, PSTR("{\"status\":\"ok\",\"palette\":%d}"), id);
+  } else {
+    sendJson(400, "{\"error\":\"missing id parameter\"}");
+  }
+}
+
+// /api/uploadPalette?slot=0&colors=RRGGBB,RRGGBB,...（1-16 色，不足 16 色時平均展開）
+void handleUploadPalette() {
+  beginRequest();
+  if (!server.hasArg("slot") || !server.hasArg("colors")) {
+    server.send(400, "application/json", "{\"error\":\"missing slot or colors parameter\"}");
+    return;
+  }
+  int slot = server.arg("slot").toInt();
+  if (slot < 0 || slot >= PALETTE_USER_SLOTS) {
+    server.send(400, "application/json", "{\"error\":\"slot out of range\"}");
+    return;
+  }
+  CRGB colors[16];
+  uint8_t count = 0;
+  String arg = server.arg("colors");
+  const char* p = arg.c_str();
+  while (*p) {
+    // 每色必須剛好 6 個十六進位字元，後面只能接逗號或結尾（strtoul 會吃 "0x"、空白與正負號）
+    uint32_t rgb = 0;
+    uint8_t digits = 0;
+    for (; isxdigit((unsigned char)*p); p++, digits++) {
+      char c = tolower((unsigned char)*p);
+      rgb = (rgb << 4) | (uint32_t)(c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+    if (digits != 6 || (*p && *p != ',') || (*p == ',' && !p[1]) || count == 16) {
+      server.send(400, "application/json", "{\"error\":\"colors must be 1-16 comma separated RRGGBB values\"}");
+      return;
+    }
+    colors[count++] = CRGB(rgb);
+    if (*p) p++;
+  }
+  if (count == 0) {
+    server.send(400, "application/json", "{\"error\":\"no colors\"}");
+    return;
+  }
+  for (uint8_t i = 0; i < 16; i++) {
+    userPalettes[slot][i] = colors[i * count / 16];
+  }
+  savePalettes();
+  uint8_t id = PALETTE_BUILTIN_COUNT + slot;
+  bakePaletteChanged(id);
+  if (activePalette == id) paletteSelect(id, false);
+  server.send(200, "application/json", "{\"status\":\"ok\",\"palette\":" + String(id) + "}");
+}
+
+// ========== 自訂效果 VM ==========
+
+enum VmOp : uint8_t {
+  VM_PUSH8, VM_PUSH16, VM_I, VM_N, VM_T, VM_B,
+  VM_ADD, VM_SUB, VM_MUL, VM_DIV, VM_MOD, VM_AND, VM_OR, VM_XOR, VM_SHL, VM_SHR,
+  VM_NEG, VM_SIN, VM_COS, VM_TRI, VM_QUAD, VM_ABS, VM_MIN, VM_MAX, VM_SCALE,
+  VM_OUT_H, VM_OUT_S, VM_OUT_V,
+};
+
+// 遞迴下降編譯器：一邊產生 bytecode 一邊追蹤堆疊深度
+struct VmCompiler {
+  const char* src;
+  const char* p;
+  uint8_t* code;
+  uint8_t len;
+  uint8_t ops;
+  uint8_t depth;
+  uint8_t nest;
+  const char* error;
+
+  void skipSpace() {
+    while (*p == ' ' || *p == '\t') p++;
+  }
+  void fail(const char* msg) {
+    if (!error) error = msg;
+  }
+  void emit(uint8_t b) {
+    if (len >= VM_CODE_MAX) fail("program too long");
+    else code[len++] = b;
+  }
+  // 產生一個指令；delta 為對堆疊深度的影響
+  void op(uint8_t o, int8_t delta) {
+    emit(o);
+    ops++;
+    depth += delta;
+    if (depth > VM_STACK) fail("expression too deep");
+  }
+
+  static int8_t precedence(const char* s, uint8_t& opcode, uint8_t& width) {
+    width = 1;
+    switch (s[0]) {
+      case '|': opcode = VM_OR; return 1;
+      case '^': opcode = VM_XOR; return 2;
+      case '&': opcode = VM_AND; return 3;
+      case '<': if (s[1] != '<') return -1; width = 2; opcode = VM_SHL; return 4;
+      case '>': if (s[1] != '>') return -1; width = 2; opcode = VM_SHR; return 4;
+      case '+': opcode = VM_ADD; return 5;
+      case '-': opcode = VM_SUB; return 5;
+      case '*': opcode = VM_MUL; return 6;
+      case '/': opcode = VM_DIV; return 6;
+      case '%': opcode = VM_MOD; return 6;
+      default: return -1;
+    }
+  }
+
+  void expr(int8_t minPrec) {
+    unary();
+    while (!error) {
+      skipSpace();
+      uint8_t opcode = 0, width;
+      int8_t prec = precedence(p, opcode, width);
+      if (prec < minPrec) return;
+      p += width;
+      expr(prec + 1);
+      op(opcode, -1);
+    }
+  }
+
+  void unary() {
+    skipSpace();
+    if (*p == '-') {
+      if (++nest > VM_NEST_MAX) return fail("nested too deep");
+      p++;
+      unary();
+      nest--;
+      op(VM_NEG, 0);
+    } else {
+      primary();
+    }
+  }
+
+  void primary() {
+    skipSpace();
+    if (++nest > VM_NEST_MAX) return fail("nested too deep");
+    primaryInner();
+    nest--;
+  }
+
+  void primaryInner() {
+    if (*p == '(') {
+      p++;
+      expr(1);
+      skipSpace();
+      if (*p != ')') return fail("expected )");
+      p++;
+    } else if (*p >= '0' && *p <= '9') {
+      long v = strtol(p, (char**)&p, 10);
+      if (v > 32767) return fail("number too large");
+      if (v < 256) {
+        op(VM_PUSH8, 1);
+        emit(v);
+      } else {
+        op(VM_PUSH16, 1);
+        emit(v & 0xFF);
+        emit(v >> 8);
+      }
+    } else if (*p >= 'a' && *p <= 'z') {
+      const char* name = p;
+      while (*p >= 'a' && *p <= 'z') p++;
+      size_t n = p - name;
+      if (n == 1) {
+        switch (*name) {
+          case 'i': return op(VM_I, 1);
+          case 'n': return op(VM_N, 1);
+          case 't': return op(VM_T, 1);
+          case 'b': return op(VM_B, 1);
+        }
+        return fail("unknown variable");
+      }
+      static const struct { const char* name; uint8_t opcode; uint8_t args; } funcs[] = {
+        {"sin", VM_SIN, 1}, {"cos", VM_COS, 1}, {"tri", VM_TRI, 1}, {"quad", VM_QUAD, 1},
+        {"abs", VM_ABS, 1}, {"min", VM_MIN, 2}, {"max", VM_MAX, 2}, {"scale", VM_SCALE, 2},
+      };
+      for (const auto& f : funcs) {
+        if (strlen(f.name) != n || strncmp(f.name, name, n) != 0) continue;
+        skipSpace();
+        if (*p != '(') return fail("expected (");
+        p++;
+        for (uint8_t a = 0; a < f.args && !error; a++) {
+          if (a > 0) {
+            skipSpace();
+            if (*p != ',') return fail("expected ,");
+            p++;
+          }
+          expr(1);
+        }
+        skipSpace();
+        if (*p != ')') return fail("expected )");
+        p++;
+        return op(f.opcode, 1 - f.args);
+      }
+      fail("unknown function");
+    } else {
+      fail("unexpected character");
+    }
+  }
+};
+
+// 編譯 src；成功回傳 nullptr，失敗回傳錯誤訊息並設定 errorPos
+const char* vmCompile(const char* src, uint8_t* code, uint8_t& codeLen, uint8_t& ops, int& errorPos) {
+  VmCompiler c = {src, src, code, 0, 0, 0, 0, nullptr};
+  static const uint8_t outputs[] = {VM_OUT_H, VM_OUT_S, VM_OUT_V};
+  for (uint8_t part = 0; part < 3 && !c.error; part++) {
+    c.skipSpace();
+    if (*c.p != ';' && *c.p != '\0') {  // 空白段落使用預設值
+      c.expr(1);
+      c.op(outputs[part], -1);
+      c.skipSpace();
+    }
+    if (*c.p == '\0') break;
+    if (*c.p != ';' || part == 2) c.fail("unexpected character");
+    c.p++;
+  }
+  errorPos = c.p - src;
+  codeLen = c.len;
+  ops = c.ops;
+  return c.error;
+}
+
+// 逐像素執行 bytecode；堆疊深度已在編譯時驗證
+void vmRender() {
+  uint32_t t = effectMillis() >> 4;
+  int32_t b = beat8(60, syncTimebase());
+  for (int i = 0; i < NUM_LEDS; i++) {
+    int32_t stack[VM_STACK];
+    int32_t* sp = stack - 1;  // 指向堆疊頂端
+    int32_t h = 0, sat = 255, val = 255;
+    const uint8_t* pc = vmCode;
+    const uint8_t* end = vmCode + vmCodeLen;
+    while (pc < end) {
+      switch (*pc++) {
+        case VM_PUSH8: *++sp = *pc++; break;
+        case VM_PUSH16: *++sp = pc[0] | (pc[1] << 8); pc += 2; break;
+        case VM_I: *++sp = i; break;
+        case VM_N: *++sp = NUM_LEDS; break;
+        case VM_T: *++sp = t & 0xFFFF; break;
+        case VM_B: *++sp = b; break;
+        case VM_ADD: sp[-1] = (int32_t)((uint32_t)sp[-1] + (uint32_t)sp[0]); sp--; break;
+        case VM_SUB: sp[-1] = (int32_t)((uint32_t)sp[-1] - (uint32_t)sp[0]); sp--; break;
+        case VM_MUL: sp[-1] = (int32_t)((uint32_t)sp[-1] * (uint32_t)sp[0]); sp--; break;
+        case VM_DIV:
+          if (sp[0] == 0) sp[-1] = 0;
+          else if (sp[0] != -1) sp[-1] /= sp[0];
+          else sp[-1] = (int32_t)(0u - (uint32_t)sp[-1]);  // INT32_MIN / -1 環繞回 INT32_MIN
+          sp--;
+          break;
+        case VM_MOD: sp[-1] = (sp[0] == 0 || sp[0] == -1) ? 0 : sp[-1] % sp[0]; sp--; break;
+        case VM_AND: sp[-1] &= sp[0]; sp--; break;
+        case VM_OR: sp[-1] |= sp[0]; sp--; break;
+        case VM_XOR: sp[-1] ^= sp[0]; sp--; break;
+        case VM_SHL: sp[-1] = (uint32_t)sp[-1] << (sp[0] & 31); sp--; break;
+        case VM_SHR: sp[-1] >>= (sp[0] & 31); sp--; break;
+        case VM_NEG: sp[0] = (int32_t)(0u - (uint32_t)sp[0]); break;
+        case VM_SIN: sp[0] = sin8(sp[0]); break;
+        case VM_COS: sp[0] = cos8(sp[0]); break;
+        case VM_TRI: sp[0] = triwave8(sp[0]); break;
+        case VM_QUAD: sp[0] = quadwave8(sp[0]); break;
+        case VM_ABS: if (sp[0] < 0) sp[0] = (int32_t)(0u - (uint32_t)sp[0]); break;
+        case VM_MIN: if (sp[0] < sp[-1]) sp[-1] = sp[0]; sp--; break;
+        case VM_MAX: if (sp[0] > sp[-1]) sp[-1] = sp[0]; sp--; break;
+        case VM_SCALE: sp[-1] = (int32_t)((uint32_t)sp[-1] * (uint32_t)sp[0]) >> 8; sp--; break;
+        case VM_OUT_H: h = *sp--; break;
+        case VM_OUT_S: sat = *sp--; break;
+        case VM_OUT_V: val = *sp--; break;
+      }
+    }
+    leds[i] = CHSV(h & 0xFF, constrain(sat, 0, 255), constrain(val, 0, 255));
+  }
+}
+
+// 開機時載入已保存的效果程式；失敗時使用預設程式
+void loadProgram() {
+  File f = LittleFS.open(VM_PROGRAM_FILE, "r");
+  if (f) {
+    size_t n = f.read((uint8_t*)vmSource, VM_SOURCE_MAX - 1);
+    vmSource[n] = '\0';
+    f.close();
+  }
+  int errorPos;
+  if (vmCompile(vmSource, vmCode, vmCodeLen, vmOpsPerPixel, errorPos)) {
+    strcpy(vmSource, VM_DEFAULT_SOURCE);
+    vmCompile(vmSource, vmCode, vmCodeLen, vmOpsPerPixel, errorPos);
+  }
+}
+
+void handleProgram() {
+  beginRequest();
+  String response = "{\"status\":\"ok\",\"src\":\"";
+  for (const char* c = vmSource; *c; c++) {
+    if (*c == '"' || *c == '\\') response += '\\';
+    response += *c;
+  }
+  response += "\",\"ops\":" + String(vmOpsPerPixel) + ",\"bytes\":" + String(vmCodeLen) + "}";
+  server.send(200, "application/json", response);
+}
+
+// /api/setProgram?src=...：編譯成功才替換目前程式並保存
+void handleSetProgram() {
+  beginRequest();
+  if (!server.hasArg("src")) {
+    server.send(400, "application/json", "{\"error\":\"missing src parameter\"}");
+    return;
+  }
+  const String& src = server.arg("src");
+  if (src.length() >= VM_SOURCE_MAX) {
+    server.send(400, "application/json", "{\"error\":\"program too long\",\"pos\":0}");
+    return;
+  }
+  uint8_t code[VM_CODE_MAX];
+  uint8_t len, ops;
+  int errorPos;
+  const char* error = vmCompile(src.c_str(), code, len, ops, errorPos);
+  if (error) {
+    server.send(400, "application/json", "{\"error\":\"" + String(error) + "\",\"pos\":" + String(errorPos) + "}");
+    return;
+  }
+  memcpy(vmCode, code, len);
+  vmCodeLen = len;
+  vmOpsPerPixel = ops;
+  renderAheadFlush();
+  strcpy(vmSource, src.c_str());
+  File f = LittleFS.open(VM_PROGRAM_FILE, "w");
+  if (f) {
+    f.write((const uint8_t*)vmSource, strlen(vmSource));
+    f.close();
+  }
+  Serial.print("🧩 自訂效果: ");
+  Serial.println(vmSource);
+  server.send(200, "application/json", "{\"status\":\"ok\",\"ops\":" + String(ops) + ",\"bytes\":" + String(len) + "}");
+}
+
+// 執行期長度版本（移植到 Effect<N> 之前的寫法），只供效能比較
+static volatile uint16_t benchLength = NUM_LEDS;
+static void rainbowCycleRuntime() {
+  uint16_t n = benchLength;
+  for (uint16_t i = 0; i < n; i++) leds[i] = CHSV(demoHue + i * 255 / n, 255, 255);
+}
+static void demoRainbowRuntime() {
+  fill_rainbow(leds, benchLength, demoHue, 7);
+}
+// 與 Strip::bpm 相同的每像素工作（查表 + nscale8），只差在長度於執行期才知道
+static void demoBpmRuntime() {
+  uint16_t n = benchLength;
+  uint8_t beat = beatsin8(62, 64, 255, syncTimebase());
+  for (uint16_t i = 0; i < n; i++) {
+    CRGB c = paletteLut[(uint8_t)(demoHue + i * 2)];
+    c.nscale8(beat - demoHue + (uint8_t)(i * 10));
+    leds[i] = c;
+  }
+}
+static void rainbowCycleTemplate() {
+  Strip::rainbowCycle(leds, demoHue, 255);
+}
+
+static void benchOutputLoad() {
+  outputLoad(leds);
+}
+
+// 效能比較的項目：自訂效果 VM、手寫效果、Effect<N> 與執行期長度版本、輸出級。
+// 序列埠指令 b 在裝置上以 CPU cycle 量測；test/host 的 make bench 在主機上量測同一組
+struct BenchCase {
+  const char* name;
+  void (*fn)();
+};
+const BenchCase benchCases[] = {
+  {"vm", vmRender}, {"demoSinelon", demoSinelon},
+  {"demoBpm", demoBpm}, {"demoBpm(n)", demoBpmRuntime},
+  {"demoRainbow", demoRainbow}, {"demoRainbow(n)", demoRainbowRuntime},
+  {"rainbowCycle", rainbowCycleTemplate}, {"rainbowCycle(n)", rainbowCycleRuntime},
+  {"outputLoad", benchOutputLoad}, {"outputRefresh", outputRefresh},
+};
+
+// 序列埠指令 b：以 CPU cycle 比較各項目的每像素成本
+void runBenchmark() {
+  const uint16_t frames = 200;
+  Serial.printf("⏱️ benchmark: %u frames x %u LEDs, program \"%s\" (%u ops/pixel)\n",
+                frames, NUM_LEDS, vmSource, vmOpsPerPixel);
+  for (const BenchCase& c : benchCases) {
+    uint32_t start = ESP.getCycleCount();
+    for (uint16_t f = 0; f < frames; f++) c.fn();
+    uint32_t cycles = ESP.getCycleCount() - start;
+    Serial.printf("  %-16s %lu cycles/pixel\n", c.name, (unsigned long)(cycles / frames / NUM_LEDS));
+  }
+}
+
+// ========== OTA 韌體更新 ==========
+
+// 標準 CRC-32（與 zlib.crc32 相同），可分段累加
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static void otaFail(const char* msg) {
+  if (!otaError) {
+    otaError = msg;
+    Serial.print("⚠️ OTA 失敗: ");
+    Serial.println(msg);
+  }
+}
+
+static const char otaErrWindow[] = "updates are only accepted shortly after power-on";
+static const char otaErrAuth[] = "unauthorized";
+
+static bool otaWindowOpen() {
+  if (millis() >= OTA_BOOT_WINDOW_MS) otaWindowClosed = true;
+  return !otaWindowClosed;
+}
+
+// 設定了 OTA_PASSWORD 時檢查 HTTP Basic 認證
+static bool otaAuthenticated() {
+#ifdef OTA_PASSWORD
+  return server.authenticate(OTA_USER, OTA_PASSWORD);
+#else
+  return true;
+#endif
+}
+
+// POST /api/update?crc=XXXXXXXX[&md5=...]（multipart 上傳 .bin）
+// 每收到一段就寫入 flash；期間以較低頻率繼續渲染動畫
+void handleUpdateUpload() {
+  HTTPUpload& upload = server.upload();
+  switch (upload.status) {
+    case UPLOAD_FILE_START: {
+      otaError = nullptr;
+      otaCrc = 0;
+      otaBytes = 0;
+      if (!otaWindowOpen()) {
+        otaFail(otaErrWindow);
+        break;
+      }
+      if (!otaAuthenticated()) {
+        otaFail(otaErrAuth);
+        break;
+      }
+      otaAccepted = true;
+      resetIdleTimer();
+      Serial.print("📦 OTA 開始: ");
+      Serial.println(upload.filename);
+      uint32_t maxSpace = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+      if (!Update.begin(maxSpace, U_FLASH)) {
+        otaFail("not enough space");
+        break;
+      }
+      if (server.hasArg("md5") && !Update.setMD5(server.arg("md5").c_str())) {
+        otaFail("invalid md5");
+      }
+      break;
+    }
+    case UPLOAD_FILE_WRITE:
+      if (otaError) break;
+      if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
+        otaFail("flash write failed");
+        break;
+      }
+      otaCrc = crc32Update(otaCrc, upload.buf, upload.currentSize);
+      otaBytes += upload.currentSize;
+      if (millis() - otaLastFrame >= OTA_FRAME_INTERVAL_MS) {
+        otaLastFrame = millis();
+        resetIdleTimer();
+        renderFrame();
+        outputRefresh();
+      }
+      break;
+    case UPLOAD_FILE_END:
+      if (!otaError && server.hasArg("crc") && strtoul(server.arg("crc").c_str(), nullptr, 16) != otaCrc) {
+        otaFail("crc mismatch");
+      }
+      // 校驗通過才 end(true)：寫入開機切換指令；否則放棄，保留目前韌體
+      if (otaError) {
+        if (Update.isRunning()) Update.end(false);
+      } else if (!Update.end(true)) {
+        otaFail("image verification failed");
+      }
+      break;
+    case UPLOAD_FILE_ABORTED:
+      if (Update.isRunning()) Update.end(false);
+      otaFail("upload aborted");
+      break;
+  }
+  // 上傳在 handleClient() 內阻塞了整段時間：結束後重新排定幀時間，不把上傳期間算成漏幀
+  if (upload.status == UPLOAD_FILE_END || upload.status == UPLOAD_FILE_ABORTED) {
+    nextFrameTime = millis();
+    renderAheadFlush();  // 幀格改變，佇列中的 due 對不上
+  }
+}
+
+void handleUpdateDone() {
+  beginRequest();
+  bool accepted = otaAccepted;
+  otaAccepted = false;
+  if (!accepted) {
+    // 沒有通過檢查（或根本沒有上傳檔案）就不回報上一次的結果，也不重新啟動
+    if (otaError == otaErrAuth) {
+      server.requestAuthentication();
+    } else if (otaError == otaErrWindow) {
+      server.send(403, "application/json", "{\"error\":\"" + String(otaErrWindow) + "\"}");
+    } else {
+      server.send(400, "application/json", "{\"error\":\"missing image\"}");
+    }
+    otaError = nullptr;
+    return;
+  }
+  if (otaError || Update.hasError()) {
+    server.send(500, "application/json", "{\"error\":\"" + String(otaError ? otaError : "update failed") + "\"}");
+    return;
+  }
+  char crc[9];
+  snprintf(crc, sizeof(crc), "%08lx", (unsigned long)otaCrc);
+  server.send(200, "application/json", "{\"status\":\"ok\",\"bytes\":" + String(otaBytes) + ",\"crc\":\"" + crc + "\"}");
+  Serial.println("✅ OTA 完成，重新啟動...");
+  delay(200);
+  ESP.restart();
+}
+
+// ========== 亂數產生器 ==========
+
+// 設定種子；同時播種 FastLED 的 random8/random16，讓 Fx 效果也可重現
+void rngSeed(uint32_t seed) {
+  rngSeedValue = seed;
+  rngState = seed ? seed : 0x9E3779B9;  // xorshift 的狀態不可為 0
+  random16_set_seed((seed >> 16) ^ seed);
+}
+
+// 以隨機位元組填滿緩衝區，每 4 bytes 只產生一次亂數
+void rngFill(uint8_t* buf, size_t len) {
+  while (len >= 4) {
+    uint32_t r = rng32();
+    memcpy(buf, &r, 4);
+    buf += 4;
+    len -= 4;
+  }
+  if (len) {
+    uint32_t r = rng32();
+    memcpy(buf, &r, len);
+  }
+}
+
+// /api/seed?value=N 重新播種；不帶參數時回傳目前種子
+void handleSeed() {
+  beginRequest();
+  if (server.hasArg("value")) {
+    rngSeed(strtoul(server.arg("value").c_str(), nullptr, 10));
+    Serial.print("🎲 亂數種子: ");
+    Serial.println(rngSeedValue);
+  }
+  server.send(200, "application/json", "{\"status\":\"ok\",\"seed\":" + String(rngSeedValue) + "}");
+}
+
+// ========== 多台同步 ==========
+
+// 依時鐘模型外推 local 時的時差
+int32_t syncClockOffset(const SyncClock& c, uint32_t local) {
+  int32_t dt = local - c.base;
+  return (uint32_t)c.offset + (uint32_t)(int32_t)((int64_t)dt * c.driftPpm / 1000000);
+}
+
+// 效果時間：follower 鎖定後為估計的 leader 時間，否則為本地 millis()
+uint32_t effectMillis() {
+  uint32_t now = millis() + renderLead;
+  if (!syncClock.locked) return now;
+  return now + syncClockOffset(syncClock, now);
+}
+
+// 給 FastLED beat 函數的 timebase：GET_MILLIS() - timebase 即為效果時間
+uint32_t syncTimebase() {
+  return syncClock.locked || renderLead ? millis() - effectMillis() : 0;
+}
+
+void loadSyncConfig() {
+  File f = LittleFS.open(SYNC_FILE, "r");
+  if (!f) return;
+  uint8_t role;
+  if (f.read(&role, 1) == 1 && role <= SYNC_FOLLOWER) {
+    syncRole = role;
+    size_t n = f.read((uint8_t*)syncLeaderSsid, sizeof(syncLeaderSsid) - 1);
+    syncLeaderSsid[n] = '\0';
+  }
+  f.close();
+}
+
+static void saveSyncConfig() {
+  File f = LittleFS.open(SYNC_FILE, "w");
+  if (!f) return;
+  f.write(&syncRole, 1);
+  f.write((const uint8_t*)syncLeaderSsid, strlen(syncLeaderSsid));
+  f.close();
+}
+
+// 依角色設定 WiFi 與 UDP。follower 的 AP 改用 192.168.5.1，避免與 leader 子網路衝突
+void syncStart() {
+  syncUdp.stop();
+  syncClock = {};
+  if (syncRole == SYNC_FOLLOWER) {
+    WiFi.mode(WIFI_AP_STA);
+    WiFi.softAPConfig(IPAddress(192, 168, 5, 1), IPAddress(192, 168, 5, 1), IPAddress(255, 255, 255, 0));
+    WiFi.begin(syncLeaderSsid, TOY_PWD);
+  } else if (WiFi.getMode() != WIFI_AP) {
+    // 從 follower 切回：恢復純 AP 與預設位址
+    WiFi.disconnect();
+    WiFi.mode(WIFI_AP);
+    WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+  }
+  if (syncRole != SYNC_OFF) {
+    syncUdp.begin(SYNC_PORT);
+  }
+}
+
+static void syncSend(IPAddress ip, SyncPacket& pkt) {
+  pkt.magic = SYNC_MAGIC;
+  pkt.mode = animationMode;
+  pkt.palette = activePalette;
+  syncUdp.beginPacket(ip, SYNC_PORT);
+  syncUdp.write((const uint8_t*)&pkt, sizeof(pkt));
+  syncUdp.endPacket();
+}
+
+// 一次時間戳交換：t1 follower 送出、t2 leader 收到、t3 leader 送出、t4 follower 收到。
+// offset = ((t2 - t1) + (t3 - t4)) / 2，rtt = (t4 - t1) - (t3 - t2)；
+// 兩台 millis() 的差可以是任意值，先取 t2 - t1 再加上兩方向差值的一半，避免 int32 溢位
+SyncSample syncMakeSample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) {
+  SyncSample sample;
+  uint32_t forward = t2 - t1;
+  sample.local = t4;
+  sample.offset = forward + (uint32_t)((int32_t)((t3 - t4) - forward) / 2);
+  sample.rtt = (t4 - t1) - (t3 - t2);
+  return sample;
+}
+
+// 加入一筆樣本並更新時鐘模型：取最近 SYNC_SAMPLES 筆中往返時間最短者，
+// 與模型預測差超過 SYNC_STEP_MS 時直接跳過去，否則修正一半。
+// 回傳 true 表示時鐘跳動（首次鎖定或大幅修正），已預先渲染的幀需捨棄
+bool syncEstimate(SyncClock& c, const SyncSample& sample) {
+  memmove(&c.samples[1], &c.samples[0], (SYNC_SAMPLES - 1) * sizeof(SyncSample));
+  c.samples[0] = sample;
+  if (c.count < SYNC_SAMPLES) c.count++;
+  const SyncSample* best = &c.samples[0];
+  for (uint8_t i = 1; i < c.count; i++) {
+    if (c.samples[i].rtt < best->rtt) best = &c.samples[i];
+  }
+
+  if (!c.locked) {
+    c.offset = best->offset;
+    c.base = best->local;
+    c.anchor = *best;
+    c.locked = true;
+    return true;
+  }
+  int32_t span = best->local - c.anchor.local;
+  if (span >= SYNC_DRIFT_WINDOW_MS) {
+    int32_t change = (uint32_t)best->offset - (uint32_t)c.anchor.offset;
+    int32_t ppm = (int64_t)change * 1000000 / span;
+    c.driftPpm = constrain(ppm, -SYNC_DRIFT_MAX_PPM, SYNC_DRIFT_MAX_PPM);
+    c.anchor = *best;
+  }
+  int32_t predicted = syncClockOffset(c, best->local);
+  int32_t error = (uint32_t)best->offset - (uint32_t)predicted;
+  bool step = error > SYNC_STEP_MS || error < -SYNC_STEP_MS;
+  c.offset = step ? best->offset : (int32_t)((uint32_t)predicted + (uint32_t)(error / 2));
+  c.base = best->local;
+  return step;
+}
+
+// 每次 loop 呼叫：處理收到的封包，leader 定時廣播 beacon
+void syncService() {
+  int size;
+  while ((size = syncUdp.parsePacket()) > 0) {
+    uint32_t received = millis();
+    SyncPacket pkt;
+    if (size != sizeof(pkt) || syncUdp.read((uint8_t*)&pkt, sizeof(pkt)) != sizeof(pkt) || pkt.magic != SYNC_MAGIC) {
+      continue;
+    }
+    if (syncRole == SYNC_LEADER && pkt.type == SYNC_REQUEST) {
+      pkt.type = SYNC_REPLY;
+      pkt.t2 = received;
+      pkt.t3 = millis();
+      syncSend(syncUdp.remoteIP(), pkt);
+    } else if (syncRole == SYNC_FOLLOWER && pkt.type == SYNC_BEACON) {
+      if (pkt.mode != animationMode && pkt.mode < MODE_COUNT) setAnimationMode(pkt.mode);
+      if (pkt.palette != activePalette) paletteSelect(pkt.palette, false);
+      SyncPacket req = {};
+      req.type = SYNC_REQUEST;
+      req.t1 = millis();
+      syncSend(syncUdp.remoteIP(), req);
+    } else if (syncRole == SYNC_FOLLOWER && pkt.type == SYNC_REPLY) {
+      bool wasLocked = syncClock.locked;
+      if (!syncEstimate(syncClock, syncMakeSample(pkt.t1, pkt.t2, pkt.t3, received))) continue;
+      renderAheadFlush();  // 時鐘跳動，已渲染的幀時間錯誤
+      if (!wasLocked) {
+        Serial.print("🔗 同步鎖定，時差 ms: ");
+        Serial.println(syncClock.offset);
+      }
+    }
+  }
+
+  if (syncRole == SYNC_LEADER && millis() - syncLastBeacon >= SYNC_INTERVAL_MS) {
+    syncLastBeacon = millis();
+    SyncPacket beacon = {};
+    beacon.type = SYNC_BEACON;
+    beacon.t3 = millis();
+    IPAddress ip = WiFi.softAPIP();
+    syncSend(IPAddress(ip[0], ip[1], ip[2], 255), beacon);
+  }
+}
+
+// /api/sync?role=off|leader|follower[&leader=funXled_XXXXXX]
+// 設為 follower 後本機 AP 位址改為 192.168.5.1
+void handleSync() {
+  beginRequest();
+  if (server.hasArg("role")) {
+    const String& role = server.arg("role");
+    if (role == "leader") {
+      syncRole = SYNC_LEADER;
+    } else if (role == "follower") {
+      if (!server.hasArg("leader") || server.arg("leader").length() >= sizeof(syncLeaderSsid)) {
+        server.send(400, "application/json", "{\"error\":\"missing leader ssid\"}");
+        return;
+      }
+      strcpy(syncLeaderSsid, server.arg("leader").c_str());
+      syncRole = SYNC_FOLLOWER;
+    } else {
+      syncRole = SYNC_OFF;
+    }
+    saveSyncConfig();
+    server.send(200, "application/json", "{\"status\":\"ok\",\"role\":" + String(syncRole) + "}");
+    Serial.print("🔗 同步角色: ");
+    Serial.println(syncRole);
+    syncStart();
+    return;
+  }
+  server.send(200, "application/json", "{\"status\":\"ok\",\"role\":" + String(syncRole) +
+              ",\"locked\":" + String(syncClock.locked ? "true" : "false") +
+              ",\"offset\":" + String(syncClock.offset) + ",\"driftPpm\":" + String(syncClock.driftPpm) + "}");
+}
+
+// ========== 烘焙動畫 ==========
+
+static String bakePath(uint8_t mode) {
+  return "/bake" + String(mode) + ".bin";
+}
+
+// 只依時間而定的效果才值得烘焙；單色、清空與自訂程式會隨設定改變
+static bool bakeSupported(int mode) {
+  return mode >= 0 && mode < MODE_COUNT && mode != MODE_MONO && mode != MODE_CLEARLED && mode != MODE_CUSTOM;
+}
+
+// 從 paletteLut 取色的效果：片段只在錄製時的調色盤下重播
+static bool bakePaletteDependent(int mode) {
+  return mode == MODE_DEMO_BPM;
+}
+
+void bakeScan() {
+  bakeMask = 0;
+  for (uint8_t mode = 0; mode < MODE_COUNT; mode++) {
+    if (bakeSupported(mode) && LittleFS.exists(bakePath(mode).c_str())) bakeMask |= 1UL << mode;
+  }
+}
+
+static void bakeClose() {
+  if (bakeFile) bakeFile.close();
+  bakeState = BAKE_IDLE;
+}
+
+static void bakeRewind() {
+  bakeFile.seek(sizeof(BakeHeader));
+  memset(bakeFrame, 0, sizeof(bakeFrame));
+  bakeFrameIndex = 0;
+  bakeBufLen = bakeBufPos = 0;
+}
+
+// 跳到第 key 個關鍵幀：從索引讀出位置，解碼狀態歸零
+static bool bakeSeekKey(uint16_t key) {
+  uint32_t offset;
+  if (!bakeFile.seek(bakeIndexPos + key * 4) || bakeFile.read((uint8_t*)&offset, 4) != 4 ||
+      offset < sizeof(BakeHeader) || offset >= bakeIndexPos || !bakeFile.seek(offset)) {
+    return false;
+  }
+  memset(bakeFrame, 0, sizeof(bakeFrame));
+  bakeFrameIndex = key * bakeKeyInterval;
+  bakeBufLen = bakeBufPos = 0;
+  return true;
+}
+
+// 片段損壞時捨棄，改回即時渲染
+static void bakeDrop(uint8_t mode) {
+  bakeClose();
+  bakeMask &= ~(1UL << mode);
+  LittleFS.remove(bakePath(mode).c_str());
+  Serial.print("⚠️ 烘焙片段損壞，已刪除: 模式 ");
+  Serial.println(mode);
+}
+
+static void bakeOpen(uint8_t mode) {
+  bakeClose();
+  bakeCheckedMode = mode;  // 沒有片段也記住，避免每幀重試
+  if (!(bakeMask & (1UL << mode))) return;
+  bakeFile = LittleFS.open(bakePath(mode).c_str(), "r");
+  BakeHeader h;
+  if (!bakeFile || bakeFile.read((uint8_t*)&h, sizeof(h)) != sizeof(h) ||
+      h.magic != BAKE_MAGIC || h.version != BAKE_VERSION || h.numLeds != NUM_LEDS || h.frameCount == 0 || h.frameMs == 0 || h.keyInterval == 0 ||
+      bakeFile.size() < sizeof(h) + ((h.frameCount - 1) / h.keyInterval + 1) * 4) {
+    bakeDrop(mode);
+    return;
+  }
+  if (h.palette != BAKE_NO_PALETTE && h.palette != activePalette) {
+    bakeClose();  // 保留片段，換回原調色盤時再重播
+    return;
+  }
+  bakeFrames = h.frameCount;
+  bakeFrameMs = h.frameMs;
+  bakeKeyInterval = h.keyInterval;
+  bakeIndexPos = bakeFile.size() - ((h.frameCount - 1) / h.keyInterval + 1) * 4;
+  bakeRewind();
+  bakeState = BAKE_PLAYING;
+}
+
+// 以小區塊從 flash 串流讀取，不把整個片段載入 RAM
+static int bakeReadByte() {
+  if (bakeBufPos == bakeBufLen) {
+    bakeBufLen = bakeFile.read(bakeBuf, BAKE_READ_CHUNK);
+    bakeBufPos = 0;
+    if (bakeBufLen == 0) return -1;
+  }
+  return bakeBuf[bakeBufPos++];
+}
+
+static bool bakeDecodeFrame() {
+  if (bakeFrameIndex == bakeFrames) bakeRewind();  // 循環播放
+  uint16_t i = 0;
+  while (i < BAKE_FRAME_BYTES) {
+    int c = bakeReadByte();
+    if (c < 0) return false;
+    uint8_t n = (c & 0x7F) + 1;
+    if (i + n > BAKE_FRAME_BYTES) return false;
+    if (c & 0x80) {
+      while (n--) {
+        int d = bakeReadByte();
+        if (d < 0) return false;
+        bakeFrame[i++] ^= d;
+      }
+    } else {
+      i += n;
+    }
+  }
+  bakeFrameIndex++;
+  bakeFramesDecoded++;
+  return true;
+}
+
+// 目前模式有烘焙片段時解碼下一幀到 out 並回傳 true；否則由呼叫端即時渲染
+bool bakeRender(CRGB* out) {
+  if (bakeState == BAKE_RECORDING) return false;
+  if (animationMode != bakeCheckedMode) bakeOpen(animationMode);
+  if (bakeState != BAKE_PLAYING) return false;
+  // 依效果時間選幀：同步的玩具播放同一幀，閒置降低幀率時也自然跳過中間幀。
+  // 幀以 XOR 差分儲存只能往前解碼；往回跳或跳過整個關鍵幀區間（切換模式、同步鎖定或時鐘跳動）時
+  // 從目標幀所在區間的關鍵幀開始解碼，一幀內最多解碼 bakeKeyInterval 幀
+  uint16_t want = effectMillis() / bakeFrameMs % bakeFrames + 1;
+  uint16_t key = (want - 1) / bakeKeyInterval;
+  if ((want < bakeFrameIndex || key * bakeKeyInterval > bakeFrameIndex) && !bakeSeekKey(key)) {
+    bakeDrop(animationMode);
+    return false;
+  }
+  while (bakeFrameIndex != want) {
+    if (!bakeDecodeFrame()) {
+      bakeDrop(animationMode);
+      return false;
+    }
+  }
+  memcpy((uint8_t*)out, bakeFrame, BAKE_FRAME_BYTES);
+  return true;
+}
+
+static void bakeAbort(const char* reason) {
+  bakeClose();
+  LittleFS.remove(bakePath(bakeCheckedMode).c_str());
+  bakeCheckedMode = -1;
+  Serial.print("⚠️ 錄製中止: ");
+  Serial.println(reason);
+}
+
+// 調色盤切換（editedId = -1）或自訂調色盤 editedId 內容改變
+void bakePaletteChanged(int editedId) {
+  if (bakeCheckedMode >= 0 && bakePaletteDependent(bakeCheckedMode)) {
+    if (bakeState == BAKE_RECORDING) {
+      bakeAbort("調色盤已切換");
+    } else {
+      bakeClose();
+      bakeCheckedMode = -1;  // 下一幀依新調色盤重新檢查
+    }
+  }
+  // 自訂調色盤內容改變時，刪掉以舊內容錄成的片段
+  if (editedId < 0) return;
+  for (uint8_t mode = 0; mode < MODE_COUNT; mode++) {
+    if (!bakePaletteDependent(mode) || !(bakeMask & (1UL << mode))) continue;
+    File f = LittleFS.open(bakePath(mode).c_str(), "r");
+    BakeHeader h;
+    bool stale = f && f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && h.palette == editedId;
+    if (f) f.close();
+    if (stale) {
+      bakeMask &= ~(1UL << mode);
+      LittleFS.remove(bakePath(mode).c_str());
+    }
+  }
+}
+
+// 開始錄製；失敗時回傳錯誤訊息
+const char* bakeStart(uint8_t mode, uint16_t seconds) {
+  if (bakeState == BAKE_RECORDING) bakeAbort("重新錄製");
+  bakeClose();
+  bakeMask &= ~(1UL << mode);
+  bakeFile = LittleFS.open(bakePath(mode).c_str(), "w");
+  if (!bakeFile) return "cannot open file";
+  // 開檔（截斷舊片段）後才計算剩餘空間
+  FSInfo info;
+  LittleFS.info(info);
+  size_t freeBytes = info.totalBytes > info.usedBytes ? info.totalBytes - info.usedBytes : 0;
+  bakeBytesLimit = freeBytes > BAKE_FS_RESERVE + sizeof(bakeKeyOffsets) ? freeBytes - BAKE_FS_RESERVE - sizeof(bakeKeyOffsets) : 0;
+  if (bakeBytesLimit < sizeof(BakeHeader) + BAKE_FRAME_BYTES * 2) {
+    bakeFile.close();
+    LittleFS.remove(bakePath(mode).c_str());
+    return "not enough space";
+  }
+  // 幀數在錄製結束時回填
+  uint8_t palette = bakePaletteDependent(mode) ? activePalette : BAKE_NO_PALETTE;
+  BakeHeader h = {BAKE_MAGIC, BAKE_VERSION, mode, NUM_LEDS, palette, 0, FRAME_INTERVAL_MS, BAKE_KEYFRAME_FRAMES};
+  memcpy(bakeOut, &h, sizeof(h));
+  bakeOutLen = bakeBytes = sizeof(h);
+  memset(bakeFrame, 0, sizeof(bakeFrame));
+  bakeFrames = 0;
+  bakeRecordTarget = (uint32_t)seconds * 1000 / FRAME_INTERVAL_MS;
+  bakeState = BAKE_RECORDING;
+  bakeCheckedMode = mode;
+  playlistEnabled = false;  // 錄製期間不可切換模式
+  setAnimationMode(mode);
+  Serial.print("🎞️ 開始錄製: 模式 ");
+  Serial.print(mode);
+  Serial.print(", ");
+  Serial.print(bakeRecordTarget);
+  Serial.println(" 幀");
+  return nullptr;
+}
+
+static bool bakeFlush() {
+  if (bakeFile.write(bakeOut, bakeOutLen) != bakeOutLen) {
+    bakeAbort("空間不足");
+    return false;
+  }
+  bakeOutLen = 0;
+  return true;
+}
+
+// 在渲染路徑上只做編碼；flash 寫入交給 bakeService()
+void bakeRecordFrame(const CRGB* src) {
+  if (bakeFrames >= bakeRecordTarget) return;  // 已錄完，等 bakeService() 收尾
+  if (animationMode != bakeCheckedMode) {
+    bakeAbort("模式已切換");
+    return;
+  }
+  // loop() 來不及寫出時才在這裡寫入，正常情況不會發生
+  if (bakeOutLen + BAKE_FRAME_BYTES * 2 > (int)sizeof(bakeOut) && !bakeFlush()) return;
+  // 關鍵幀與全黑幀做 XOR，重播時可從這裡直接開始解碼
+  if (bakeFrames % BAKE_KEYFRAME_FRAMES == 0) memset(bakeFrame, 0, sizeof(bakeFrame));
+  // 與上一幀做 XOR + RLE；最壞情況每個位元組前都有一個控制碼
+  const uint8_t* cur = (const uint8_t*)src;
+  uint8_t* out = bakeOut + bakeOutLen;
+  uint16_t len = 0;
+  uint16_t i = 0;
+  while (i < BAKE_FRAME_BYTES) {
+    uint16_t start = i;
+    if (cur[i] == bakeFrame[i]) {
+      while (i < BAKE_FRAME_BYTES && i - start < 128 && cur[i] == bakeFrame[i]) i++;
+      out[len++] = i - start - 1;
+    } else {
+      while (i < BAKE_FRAME_BYTES && i - start < 128 && cur[i] != bakeFrame[i]) i++;
+      out[len++] = 0x80 | (i - start - 1);
+      for (uint16_t k = start; k < i; k++) {
+        out[len++] = cur[k] ^ bakeFrame[k];
+        bakeFrame[k] = cur[k];
+      }
+    }
+  }
+  if (bakeBytes + len > bakeBytesLimit) {
+    bakeRecordTarget = bakeFrames;  // 空間用完：保留已錄的幀，提前結束
+    Serial.println("⚠️ 儲存空間已滿，提前結束錄製");
+    return;
+  }
+  if (bakeFrames % BAKE_KEYFRAME_FRAMES == 0) bakeKeyOffsets[bakeFrames / BAKE_KEYFRAME_FRAMES] = bakeBytes;
+  bakeOutLen += len;
+  bakeBytes += len;
+  bakeFrames++;
+}
+
+// loop() 在幀與幀之間呼叫：累積滿 BAKE_WRITE_CHUNK 才寫入 flash，錄完時寫出剩餘資料與關鍵幀索引並回填幀數
+bool bakeService() {
+  if (bakeState != BAKE_RECORDING) return false;
+  bool done = bakeFrames >= bakeRecordTarget;
+  if (bakeOutLen < BAKE_WRITE_CHUNK && !done) return false;
+  if (!bakeFlush() || !done) return true;
+  if (bakeFrames == 0) {
+    bakeAbort("空間不足");
+    return true;
+  }
+  size_t indexBytes = ((bakeFrames - 1) / BAKE_KEYFRAME_FRAMES + 1) * 4;
+  if (bakeFile.write((const uint8_t*)bakeKeyOffsets, indexBytes) != indexBytes) {
+    bakeAbort("空間不足");
+    return true;
+  }
+  uint8_t palette = bakePaletteDependent(bakeCheckedMode) ? activePalette : BAKE_NO_PALETTE;
+  BakeHeader h = {BAKE_MAGIC, BAKE_VERSION, (uint8_t)bakeCheckedMode, NUM_LEDS, palette, bakeFrames, FRAME_INTERVAL_MS,
+                  BAKE_KEYFRAME_FRAMES};
+  bakeFile.seek(0);
+  bakeFile.write((const uint8_t*)&h, sizeof(h));
+  Serial.print("🎞️ 錄製完成: ");
+  Serial.print(bakeFrames);
+  Serial.print(" 幀, ");
+  Serial.print(bakeFile.size());
+  Serial.println(" bytes");
+  bakeClose();
+  bakeMask |= 1UL << bakeCheckedMode;
+  bakeCheckedMode = -1;  // 下一幀開檔重播
+  return true;
+}
+
+// /api/bake?mode=N&seconds=S 錄製；?mode=N&delete=1 刪除；不帶參數回傳狀態
+void handleBake() {
+  beginRequest();
+  if (server.hasArg("mode")) {
+    int mode = server.arg("mode").toInt();
+    if (!bakeSupported(mode)) {
+      server.send(400, "application/json", "{\"error\":\"mode cannot be baked\"}");
+      return;
+    }
+    if (server.hasArg("delete")) {
+      if (bakeCheckedMode == mode) {
+        bakeClose();
+        bakeCheckedMode = -1;
+      }
+      bakeMask &= ~(1UL << mode);
+      LittleFS.remove(bakePath(mode).c_str());
+      server.send(200, "application/json", "{\"status\":\"ok\"}");
+      return;
+    }
+    int seconds = server.hasArg("seconds") ? server.arg("seconds").toInt() : 10;
+    if (seconds < 1 || seconds > BAKE_SECONDS_MAX) {
+      server.send(400, "application/json", "{\"error\":\"seconds out of range\"}");
+      return;
+    }
+    const char* err = bakeStart(mode, seconds);
+    if (err) {
+      server.send(500, "application/json", "{\"error\":\"" + String(err) + "\"}");
+      return;
+    }
+    server.send(200, "application/json", "{\"status\":\"ok\",\"frames\":" + String(bakeRecordTarget) + "}");
+    return;
+  }
+  String response = "{\"status\":\"ok\",\"state\":" + String(bakeState) +
+                    ",\"frame\":" + String(bakeState == BAKE_PLAYING ? bakeFrameIndex : bakeFrames) +
+                    ",\"clips\":[";
+  bool first = true;
+  for (uint8_t mode = 0; mode < MODE_COUNT; mode++) {
+    if (!(bakeMask & (1UL << mode))) continue;
+    if (!first) response += ",";
+    response += String(mode);
+    first = false;
+  }
+  response += "]}";
+  server.send(200, "application/json", response);
+}
+
+// ========== 輸出級 ==========
+
+// 建立 gamma 表：8-bit 輸入對應 8.8 定點線性亮度（最大 255.0）
+void initOutput() {
+  for (int v = 0; v < 256; v++) {
+    gammaLut[v] = (uint16_t)(powf(v / 255.0f, OUTPUT_GAMMA) * 65280.0f + 0.5f);
+  }
+}
+
+// 每個渲染幀呼叫一次：套用 gamma、白平衡、亮度與電源比例，算出 8.8 目標值，
+// 同一趟迴圈累加各通道工作週期來估算電流
+void outputLoad(const CRGB* src) {
+  uint32_t scale[3];
+  uint8_t brightness = idleStage >= IDLE_DIM ? ledBrightness * IDLE_DIM_SCALE >> 8 : ledBrightness;
+  for (uint8_t c = 0; c < 3; c++) {
+    uint8_t wb = (OUTPUT_WHITE_BALANCE >> (16 - 8 * c)) & 0xFF;
+    scale[c] = ((uint32_t)(wb + 1) * (brightness + 1) * powerScale) >> 8;  // 最大 65536
+  }
+  uint8_t fraction = 0;
+  uint32_t duty = 0;  // 所有通道 8.8 值總和
+  for (int i = 0; i < NUM_LEDS; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      uint16_t t = ((uint32_t)gammaLut[src[i][c]] * scale[c]) >> 16;
+      t &= 0xFF00 | OUTPUT_DITHER_MASK;
+      outTarget[i][c] = t;
+      fraction |= t & 0xFF;
+      duty += t;
+    }
+  }
+  uint32_t ledMa = duty * POWER_MA_PER_CHANNEL / 65280;
+  powerEstimateMa = ledMa + NUM_LEDS * POWER_MA_IDLE_PER_LED;
+
+  // 依本幀估計值調整下一幀比例：超標立即下修並縮放本幀，未超標每幀最多回升 8/256
+  if (powerBudgetMa == 0) {
+    powerScale = 256;
+  } else {
+    uint32_t limitMa = powerEffectiveMa > NUM_LEDS * POWER_MA_IDLE_PER_LED
+                           ? powerEffectiveMa - NUM_LEDS * POWER_MA_IDLE_PER_LED : 1;
+    uint32_t fit = ledMa ? (uint32_t)powerScale * limitMa / ledMa : 256;
+    if (ledMa > limitMa) {
+      powerScale = max<uint32_t>(fit, 1);
+      powerLimitedFrames++;
+      // 本幀已超標（例如突然切到全白）：立即縮放本幀，不等下一幀；比例無條件捨去，縮放後必定不超過預算
+      uint16_t s = limitMa * 256 / ledMa;
+      duty = 0;
+      fraction = 0;
+      for (int i = 0; i < NUM_LEDS; i++) {
+        for (uint8_t c = 0; c < 3; c++) {
+          outTarget[i][c] = ((uint32_t)outTarget[i][c] * s >> 8) & (0xFF00 | OUTPUT_DITHER_MASK);
+          fraction |= outTarget[i][c] & 0xFF;
+          duty += outTarget[i][c];
+        }
+      }
+      powerEstimateMa = duty * POWER_MA_PER_CHANNEL / 65280 + NUM_LEDS * POWER_MA_IDLE_PER_LED;
+    } else if (powerScale < 256) {
+      powerScale = min<uint32_t>(min<uint32_t>(fit, powerScale + 8), 256);
+    }
+  }
+
+  outputDithering = fraction != 0;
+  outputDirty = true;
+}
+
+// 量測供電電壓並依電壓收緊電流預算
+void powerUpdateVcc() {
+  lastVccCheck = millis();
+  vccMillivolts = ESP.getVcc();
+  uint32_t percent = 100;
+  if (vccMillivolts <= POWER_VCC_MIN_MV) {
+    percent = POWER_VCC_MIN_PERCENT;
+  } else if (vccMillivolts < POWER_VCC_FULL_MV) {
+    percent = POWER_VCC_MIN_PERCENT + (100 - POWER_VCC_MIN_PERCENT) *
+              (uint32_t)(vccMillivolts - POWER_VCC_MIN_MV) / (POWER_VCC_FULL_MV - POWER_VCC_MIN_MV);
+  }
+  powerEffectiveMa = (uint32_t)powerBudgetMa * percent / 100;
+}
+
+// /api/setPowerBudget?ma=N（0 = 不限制）
+void handleSetPowerBudget() {
+  beginRequest();
+  if (server.hasArg("ma")) {
+    powerBudgetMa = constrain(server.arg("ma").toInt(), 0, 5000);
+    powerUpdateVcc();
+    Serial.print("🔋 電流預算: ");
+    Serial.println(powerBudgetMa);
+    sendJsonf(200, PSTR("{\"status\":\"ok\",\"budgetMa\":%u,\"effectiveMa\":%u}"), (unsigned)powerBudgetMa, (unsigned)powerEffectiveMa);
+  } else {
+    sendJson(400, "{\"error\":\"missing ma parameter\"}");
+  }
+}
+
+// 高頻刷新：整數部分 + 累積小數進位，平均亮度等於 8.8 目標值
+void outputRefresh() {
+  // 幀間休眠階段一幀只刷新一次（約 8Hz），累積誤差的抖動會變成看得見的閃爍：改為直接四捨五入
+  bool dither = idleStage < IDLE_LIGHT;
+  for (int i = 0; i < NUM_LEDS; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      uint16_t t = outTarget[i][c];
+      if (dither) {
+        uint16_t acc = outError[i][c] + (t & 0xFF);
+        outLeds[i][c] = (t >> 8) + (acc >> 8);
+        outError[i][c] = acc & 0xFF;
+      } else {
+        outLeds[i][c] = (t + 0x80) >> 8;  // t 最大 0xFF00，不會溢位
+      }
+    }
+  }
+  unsigned long t0 = micros();
+  {
+    TRACE_SCOPE(TRACE_SHOW);
+    FastLED.show();
+  }
+  lastRefresh = micros();
+  histObserve(showHist, lastRefresh - t0);
+  outputDirty = false;
+}
+
+// 色彩插值函數：平滑過渡從 from 色到 to 色
+// t: 當前進度（0 ~ max_t），max_t: 最大進度
+CRGB lerpColor(CRGB from, CRGB to, uint16_t t, uint16_t max_t) {
+  if (t >= max_t) return to;
+  if (t <= 0) return from;
+  
+  uint16_t ratio = (t * 256) / max_t;  // 0~256，256 表示 100% 到達目標色
+  uint8_t r = (from.r * (256 - ratio) + to.r * ratio) / 256;
+  uint8_t g = (from.g * (256 - ratio) + to.g * ratio) / 256;
+  uint8_t b = (from.b * (256 - ratio) + to.b * ratio) / 256;
+  
+  return CRGB(r, g, b);
+}
+
+// ========== 播放清單 ==========
+
+// 從 LittleFS 載入播放清單；檔案不存在或格式不符時使用預設清單
+void loadPlaylist() {
+  File f = LittleFS.open(PLAYLIST_FILE, "r");
+  if (f) {
+    PlaylistHeader hdr;
+    if (f.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+        hdr.magic == PLAYLIST_MAGIC && hdr.version == PLAYLIST_VERSION && hdr.count <= PLAYLIST_MAX) {
+      size_t bytes = hdr.count * sizeof(PlaylistPreset);
+      if (f.read((uint8_t*)playlist, bytes) == (int)bytes) {
+        playlistCount = hdr.count;
+        playlistEnabled = hdr.enabled && playlistCount > 0;
+        f.close();
+        Serial.print("📋 播放清單已載入: ");
+        Serial.println(playlistCount);
+        return;
+      }
+    }
+    f.close();
+    Serial.println("⚠️ 播放清單格式錯誤，改用預設清單");
+  }
+  playlistCount = sizeof(defaultPlaylist) / sizeof(defaultPlaylist[0]);
+  memcpy_P(playlist, defaultPlaylist, sizeof(defaultPlaylist));
+  playlistEnabled = false;
+}
+
+void savePlaylist() {
+  File f = LittleFS.open(PLAYLIST_FILE, "w");
+  if (!f) {
+    Serial.println("⚠️ 無法寫入播放清單");
+    return;
+  }
+  PlaylistHeader hdr = {PLAYLIST_MAGIC, PLAYLIST_VERSION, playlistCount, (uint8_t)(playlistEnabled ? 1 : 0)};
+  f.write((const uint8_t*)&hdr, sizeof(hdr));
+  f.write((const uint8_t*)playlist, playlistCount * sizeof(PlaylistPreset));
+  f.close();
+}
+
+// 套用指定預設並排定下一次切換時間
+void playlistApply(uint8_t index) {
+  if (playlistCount == 0) {
+    playlistEnabled = false;
+    return;
+  }
+  playlistIndex = index % playlistCount;
+  const PlaylistPreset& p = playlist[playlistIndex];
+  monoColor = CRGB(p.r, p.g, p.b);
+  ledBrightness = p.brightness;
+  setAnimationMode(p.mode);
+  playlistNextSwitch = millis() + (unsigned long)p.seconds * 1000UL;
+}
+
+void playlistAdvance() {
+  playlistApply(playlistIndex + 1);
+}
+
+void handlePlaylist() {
+  beginRequest();
+  String response = "{\"status\":\"ok\",\"enabled\":" + String(playlistEnabled ? "true" : "false") +
+                    ",\"index\":" + String(playlistIndex) + ",\"presets\":[";
+  for (uint8_t i = 0; i < playlistCount; i++) {
+    const PlaylistPreset& p = playlist[i];
+    if (i > 0) response += ",";
+    response += "{\"mode\":" + String(p.mode) + ",\"brightness\":" + String(p.brightness) +
+                ",\"r\":" + String(p.r) + ",\"g\":" + String(p.g) + ",\"b\":" + String(p.b) +
+                ",\"seconds\":" + String(p.seconds) + "}";
+  }
+  response += "]}";
+  server.send(200, "application/json", response);
+}
+
+// /api/setPreset?index=N&mode=&brightness=&r=&g=&b=&seconds=
+// index 等於目前筆數時新增一筆；未提供的欄位保留原值
+void handleSetPreset() {
+  beginRequest();
+  if (!server.hasArg("index")) {
+    server.send(400, "application/json", "{\"error\":\"missing index parameter\"}");
+    return;
+  }
+  int index = server.arg("index").toInt();
+  if (index < 0 || index > playlistCount || index >= PLAYLIST_MAX) {
+    server.send(400, "application/json", "{\"error\":\"index out of range\"}");
+    return;
+  }
+  PlaylistPreset p = (index < playlistCount) ? playlist[index] : PlaylistPreset{MODE_RAINBOW, 255, 0, 255, 255, 30};
+  if (server.hasArg("mode")) p.mode = constrain(server.arg("mode").toInt(), 0, MODE_COUNT - 1);
+  if (server.hasArg("brightness")) p.brightness = constrain(server.arg("brightness").toInt(), 0, 255);
+  if (server.hasArg("r")) p.r = constrain(server.arg("r").toInt(), 0, 255);
+  if (server.hasArg("g")) p.g = constrain(server.arg("g").toInt(), 0, 255);
+  if (server.hasArg("b")) p.b = constrain(server.arg("b").toInt(), 0, 255);
+  if (server.hasArg("seconds")) p.seconds = constrain(server.arg("seconds").toInt(), 1, 65535);
+  playlist[index] = p;
+  if (index == playlistCount) playlistCount++;
+  savePlaylist();
+  server.send(200, "application/json", "{\"status\":\"ok\",\"count\":" + String(playlistCount) + "}");
+}
+
+void handleDeletePreset() {
+  beginRequest();
+  if (!server.hasArg("index")) {
+    server.send(400, "application/json", "{\"error\":\"missing index parameter\"}");
+    return;
+  }
+  int index = server.arg("index").toInt();
+  if (index < 0 || index >= playlistCount) {
+    server.send(400, "application/json", "{\"error\":\"index out of range\"}");
+    return;
+  }
+  memmove(&playlist[index], &playlist[index + 1], (playlistCount - index - 1) * sizeof(PlaylistPreset));
+  playlistCount--;
+  if (playlistCount == 0) playlistEnabled = false;
+  if (playlistIndex >= playlistCount) playlistIndex = 0;
+  savePlaylist();
+  server.send(200, "application/json", "{\"status\":\"ok\",\"count\":" + String(playlistCount) + "}");
+}
+
+void handleTogglePlaylist() {
+  beginRequest();
+  playlistEnabled = !playlistEnabled && playlistCount > 0;
+  if (playlistEnabled) playlistApply(0);
+  savePlaylist();
+  Serial.print("📋 播放清單: ");
+  Serial.println(playlistEnabled ? "啟用" : "停用");
+  sendJsonf(200, PSTR("{\"status\":\"ok\",\"enabled\":%s}"), playlistEnabled ? "true" : "false");
+}
+
+// ========== 執行期指標 ==========
+
+// 記錄一筆耗時樣本：找出最小的 k 使 us ≤ 2^k
+void histObserve(Histogram& h, uint32_t us) {
+  uint8_t k = (us <= 1) ? 0 : 32 - __builtin_clz(us - 1);
+  if (k >= HIST_BUCKETS) k = HIST_BUCKETS - 1;
+  h.buckets[k]++;
+  h.count++;
+  h.sumUs += us;
+}
+
+// 把 Print 輸出累積成小段，用 chunked 編碼送出，不必組出整個 String
+class ChunkedResponse : public Print {
+ public:
+  size_t write(uint8_t c) override {
+    buf[len++] = c;
+    if (len == sizeof(buf)) finish();
+    return 1;
+  }
+  void finish() {
+    if (len) server.sendContent(buf, len);
+    len = 0;
+  }
+ private:
+  char buf[256];
+  size_t len = 0;
+};
+
+// 直方圖第 i 段：0 = 標頭，1..HIST_BUCKETS-1 = 各桶累計，最後一段 = +Inf 與 sum/count（同一段輸出，數字一致）
+static void writeHistogramStep(Print& out, const char* name, const char* help, const Histogram& h, uint8_t i) {
+  if (i == 0) {
+    out.printf_P(PSTR("# HELP %s %s\n# TYPE %s histogram\n"), name, help, name);
+  } else if (i < HIST_BUCKETS) {
+    uint32_t cumulative = 0;
+    for (uint8_t k = 0; k < i; k++) cumulative += h.buckets[k];
+    out.printf_P(PSTR("%s_bucket{le=\"0.%06lu\"} %lu\n"), name, 1UL << (i - 1), (unsigned long)cumulative);
+  } else {
+    out.printf_P(PSTR("%s_bucket{le=\"+Inf\"} %lu\n"), name, (unsigned long)h.count);
+    out.printf_P(PSTR("%s_sum %lu.%06lu\n%s_count %lu\n"), name,
+                 (unsigned long)(h.sumUs / 1000000), (unsigned long)(h.sumUs % 1000000),
+                 name, (unsigned long)h.count);
+  }
+}
+
+static void writeMetric(Print& out, const char* name, const char* type, const char* help, unsigned long value) {
+  out.printf_P(PSTR("# HELP %s %s\n# TYPE %s %s\n%s %lu\n"), name, help, name, type, name, value);
+}
+
+static void writeMetricSigned(Print& out, const char* name, const char* type, const char* help, long value) {
+  out.printf_P(PSTR("# HELP %s %s\n# TYPE %s %s\n%s %ld\n"), name, help, name, type, name, value);
+}
+
+struct HistogramMetric {
+  const char* name;
+  const char* help;
+  const Histogram* hist;
+};
+
+static const HistogramMetric histogramMetrics[] = {
+  {"funxled_animation_seconds", "updateAnimation() duration", &animHist},
+  {"funxled_show_seconds", "FastLED.show() duration", &showHist},
+  {"funxled_loop_seconds", "loop() busy time of passes that did work, excluding frame delay", &loopHist},
+  {"funxled_http_handler_seconds", "handleClient() time when a request was served", &httpHist},
+};
+
+#define SCALAR_METRICS 24
+
+static void writeScalarMetric(Print& out, uint8_t i) {
+  switch (i) {
+    case 0: writeMetric(out, "funxled_free_heap_bytes", "gauge", "Free heap", ESP.getFreeHeap()); break;
+    case 1: writeMetric(out, "funxled_heap_max_free_block_bytes", "gauge", "Largest free heap block", ESP.getMaxFreeBlockSize()); break;
+    case 2: writeMetric(out, "funxled_heap_fragmentation_percent", "gauge", "Heap fragmentation", ESP.getHeapFragmentation()); break;
+    case 3: writeMetric(out, "funxled_ap_stations", "gauge", "Stations connected to the soft-AP", WiFi.softAPgetStationNum()); break;
+    case 4: writeMetric(out, "funxled_animation_mode", "gauge", "Current animation mode", animationMode); break;
+    case 5: writeMetric(out, "funxled_vibration_events_total", "counter", "Vibration events", vibrationEvents); break;
+    case 6: writeMetric(out, "funxled_frames_rendered_total", "counter", "Frames rendered", framesRendered); break;
+    case 7: writeMetric(out, "funxled_frames_dropped_total", "counter", "Frames missed against FRAME_INTERVAL_MS", framesDropped); break;
+    case 8: writeMetric(out, "funxled_http_requests_total", "counter", "HTTP requests served", httpRequests); break;
+    case 9: writeMetric(out, "funxled_vcc_millivolts", "gauge", "Supply voltage from ESP.getVcc()", vccMillivolts); break;
+    case 10: writeMetric(out, "funxled_power_estimate_milliamps", "gauge", "Estimated LED current of the last frame", powerEstimateMa); break;
+    case 11: writeMetric(out, "funxled_power_budget_milliamps", "gauge", "LED current budget after Vcc derating", powerEffectiveMa); break;
+    case 12: writeMetric(out, "funxled_power_limited_frames_total", "counter", "Frames dimmed by the power limiter", powerLimitedFrames); break;
+    case 13: writeMetric(out, "funxled_sync_role", "gauge", "0=off 1=leader 2=follower", syncRole); break;
+    case 14: writeMetric(out, "funxled_sync_locked", "gauge", "Follower has a clock estimate", syncClock.locked); break;
+    case 15: writeMetricSigned(out, "funxled_sync_offset_ms", "gauge", "Estimated leader minus local clock", syncClock.offset); break;
+    case 16: writeMetricSigned(out, "funxled_sync_drift_ppm", "gauge", "Estimated leader clock drift", syncClock.driftPpm); break;
+    case 17: writeMetric(out, "funxled_idle_timeout_seconds", "gauge", "Idle time before deep sleep", idleTimeout / 1000); break;
+    case 18: writeMetric(out, "funxled_power_state", "gauge", "0=active 1=dim 2=radio 3=light", idleStage); break;
+    case 19: writeMetric(out, "funxled_render_queue_depth", "gauge", "Frames rendered ahead and waiting", renderQueueCount); break;
+    case 20: writeMetric(out, "funxled_render_queue_underruns_total", "counter", "Frames rendered on time because the queue was empty", renderUnderruns); break;
+    case 21: writeMetric(out, "funxled_render_holds_total", "counter", "Frames skipped after a flush because effects were already rendered past them", renderHolds); break;
+    case 22: writeMetric(out, "funxled_bake_frames_decoded_total", "counter", "Baked frames decoded, including catch-up after a seek", bakeFramesDecoded); break;
+    case 23: writeMetric(out, "funxled_uptime_seconds", "counter", "Seconds since boot", millis() / 1000); break;
+  }
+}
+
+// 依標籤展開的 counter：第 0 段是標頭，之後每段一個標籤值
+struct LabeledMetric {
+  const char* name;
+  const char* help;
+  uint8_t count;
+  void (*line)(Print& out, const char* name, uint8_t i);
+};
+
+static const LabeledMetric labeledMetrics[] = {
+  {"funxled_power_state_seconds_total", "Time spent in each idle power state", IDLE_STAGES,
+   [](Print& out, const char* name, uint8_t i) {
+     out.printf_P(PSTR("%s{state=\"%u\"} %lu\n"), name, i, (unsigned long)idleStageSeconds(i));
+   }},
+  // 每個模式一列，mode 為標籤；只輸出渲染過的模式
+  {"funxled_mode_frames_total", "Frames rendered per mode", MODE_COUNT,
+   [](Print& out, const char* name, uint8_t i) {
+     if (modeStats[i].frames) out.printf_P(PSTR("%s{mode=\"%u\"} %lu\n"), name, i, (unsigned long)modeStats[i].frames);
+   }},
+  {"funxled_mode_render_seconds_total", "Effect render time per mode", MODE_COUNT,
+   [](Print& out, const char* name, uint8_t i) {
+     const ModeStats& m = modeStats[i];
+     if (m.frames) out.printf_P(PSTR("%s{mode=\"%u\"} %lu.%06lu\n"), name, i,
+                                (unsigned long)(m.renderUs / 1000000), (unsigned long)(m.renderUs % 1000000));
+   }},
+  {"funxled_mode_led_milliamp_seconds_total", "Estimated LED charge per mode at FRAME_INTERVAL_MS", MODE_COUNT,
+   [](Print& out, const char* name, uint8_t i) {
+     const ModeStats& m = modeStats[i];
+     if (m.frames) out.printf_P(PSTR("%s{mode=\"%u\"} %lu\n"), name, i, (unsigned long)(m.ledMaFrames * FRAME_INTERVAL_MS / 1000));
+   }},
+  {"funxled_render_queue_pops_total", "Frames presented by queue depth at the time (0 = rendered on time)", RENDER_AHEAD_FRAMES + 1,
+   [](Print& out, const char* name, uint8_t i) {
+     out.printf_P(PSTR("%s{depth=\"%u\"} %lu\n"), name, i, (unsigned long)renderQueueDepthPops[i]);
+   }},
+};
+
+// /api/metrics 的第 step 段；超過最後一段時回傳 false。每段最多一個指標或一行，
+// 不超過 STREAM_STEP_MAX 位元組，由 streamService() 依 TCP 視窗逐段產生、逐 chunk 送出
+bool writeMetricsStep(Print& out, uint16_t step) {
+  for (const HistogramMetric& m : histogramMetrics) {
+    if (step <= HIST_BUCKETS) {
+      writeHistogramStep(out, m.name, m.help, *m.hist, step);
+      return true;
+    }
+    step -= HIST_BUCKETS + 1;
+  }
+  if (step < SCALAR_METRICS) {
+    writeScalarMetric(out, step);
+    return true;
+  }
+  step -= SCALAR_METRICS;
+  for (const LabeledMetric& m : labeledMetrics) {
+    if (step <= m.count) {
+      if (step == 0) {
+        out.printf_P(PSTR("# HELP %s %s\n# TYPE %s counter\n"), m.name, m.help, m.name);
+      } else {
+        m.line(out, m.name, step - 1);
+      }
+      return true;
+    }
+    step -= m.count + 1;
+  }
+  return false;
+}
+
+void handleMetrics() {
+  beginRequest();
+  streamBeginSteps("text/plain; version=0.0.4", writeMetricsStep);
+}
+
+// ========== 記憶體配置追蹤 ==========
+
+#if ALLOC_TRACKING
+// 每塊配置前面加一個標頭，記住大小與配置時的區段。tag 為標頭位址 ^ ALLOC_TAG：
+// SDK / libc 內部直接呼叫未包裝的配置函數拿到的記憶體，之後可能經過這裡的 free()，
+// tag 對不上就原樣交給 __real_free()
+#define ALLOC_TAG 0xA110C8EDu
+struct alignas(alignof(max_align_t)) AllocHeader {
+  uint32_t tag;
+  uint32_t size : 24;
+  uint32_t region : 8;
+};
+
+static void allocCharge(uint8_t region, size_t size, void* caller) {
+  AllocStats& a = allocStats[region];
+  a.allocs++;
+  a.bytes += size;
+  a.live += size;
+  if (a.live > a.peak) a.peak = a.live;
+  a.lastCaller = caller;
+  uint32_t freeHeap = ESP.getFreeHeap();  // 只讀統計值，本身不配置
+  if (a.minFreeHeap == 0 || freeHeap < a.minFreeHeap) a.minFreeHeap = freeHeap;
+}
+
+static void allocRelease(const AllocHeader* h) {
+  AllocStats& a = allocStats[h->region];
+  a.frees++;
+  a.live -= h->size;
+}
+
+static void* allocTag(AllocHeader* h, size_t size, void* caller) {
+  h->tag = (uint32_t)(uintptr_t)h ^ ALLOC_TAG;
+  h->size = size;
+  h->region = allocRegion;
+  allocCharge(allocRegion, size, caller);
+  return h + 1;
+}
+
+// 指標是這裡配置的就回傳它的標頭，否則回傳 nullptr
+static AllocHeader* allocHeader(void* ptr) {
+  AllocHeader* h = (AllocHeader*)ptr - 1;
+  return h->tag == ((uint32_t)(uintptr_t)h ^ ALLOC_TAG) ? h : nullptr;
+}
+
+// 連結器以 --wrap 把其他目標檔對 malloc 等的呼叫導向這裡；operator new / String 都經過 malloc
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+  if (size >= (1UL << 24)) return nullptr;
+  AllocHeader* h = (AllocHeader*)__real_malloc(sizeof(AllocHeader) + size);
+  return h ? allocTag(h, size, __builtin_return_address(0)) : nullptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  if (size && count >= (1UL << 24) / size) return nullptr;
+  AllocHeader* h = (AllocHeader*)__real_calloc(1, sizeof(AllocHeader) + count * size);
+  return h ? allocTag(h, count * size, __builtin_return_address(0)) : nullptr;
+}
+
+// realloc 記成舊區塊的釋放（記到原區段）加上新區塊的配置（記到目前區段）；realloc(p, 0) 只算釋放
+void* __wrap_realloc(void* ptr, size_t size) {
+  if (!ptr) return __wrap_malloc(size);
+  AllocHeader* h = allocHeader(ptr);
+  if (!h) return __real_realloc(ptr, size);
+  if (size == 0) {
+    allocRelease(h);
+    h->tag = 0;
+    __real_free(h);
+    return nullptr;
+  }
+  if (size >= (1UL << 24)) return nullptr;
+  AllocHeader old = *h;
+  h->tag = 0;
+  AllocHeader* n = (AllocHeader*)__real_realloc(h, sizeof(AllocHeader) + size);
+  if (!n) {
+    h->tag = old.tag;  // 失敗時原區塊不變
+    return nullptr;
+  }
+  allocRelease(&old);
+  return allocTag(n, size, __builtin_return_address(0));
+}
+
+void __wrap_free(void* ptr) {
+  if (!ptr) return;
+  AllocHeader* h = allocHeader(ptr);
+  if (!h) {
+    __real_free(ptr);
+    return;
+  }
+  allocRelease(h);
+  h->tag = 0;
+  __real_free(h);
+}
+}
+
+// 記一次違規：第一次（嚴格模式下每次）印出訊息
+void allocViolation(uint32_t& counter, const char* message, void* caller) {
+  if (counter++ == 0 || ALLOC_STRICT) {
+    Serial.printf_P(PSTR("⚠️ %s, 呼叫位址 %p\n"), message, caller);
+  }
+#if ALLOC_STRICT
+  Serial.flush();
+  abort();
+#endif
+}
+
+// beginRequest() 呼叫：依 URI 切到該 handler 的區段，記下請求開始時的 live
+void allocBeginRequest(const char* uri) {
+  uint8_t slot = 0;
+  for (; slot < ALLOC_HANDLER_SLOTS - 1 && allocHandlerUri[slot][0]; slot++) {
+    if (strncmp(allocHandlerUri[slot], uri, ALLOC_URI_MAX - 1) == 0) break;
+  }
+  // 超出槽數的 URI 都記在最後一格
+  if (!allocHandlerUri[slot][0]) strncpy(allocHandlerUri[slot], uri, ALLOC_URI_MAX - 1);
+  allocRequestRegion = ALLOC_HANDLER_FIRST + slot;
+  allocRegion = allocRequestRegion;
+  allocStats[allocRequestRegion].requests++;
+  allocRequestLive = allocStats[allocRequestRegion].live;
+  allocRequestAllocs = allocStats[allocRequestRegion].allocs;
+}
+
+// handleClient() 返回後呼叫：handler 第一次以後的請求不應配置記憶體，更不應留下配置
+void allocEndRequest() {
+  if (allocRequestRegion == ALLOC_OTHER) return;
+  const AllocStats& a = allocStats[allocRequestRegion];
+  const char* uri = allocHandlerUri[allocRequestRegion - ALLOC_HANDLER_FIRST];
+  char msg[64];
+  if (a.requests > 1 && a.live > allocRequestLive) {
+    snprintf_P(msg, sizeof(msg), PSTR("%s 請求結束後仍佔用 %lu bytes"), uri, (unsigned long)(a.live - allocRequestLive));
+    allocViolation(allocRequestViolations, msg, a.lastCaller);
+  } else if (a.requests > 1 && a.allocs > allocRequestAllocs) {
+    snprintf_P(msg, sizeof(msg), PSTR("%s 請求中配置 %lu 次"), uri, (unsigned long)(a.allocs - allocRequestAllocs));
+    allocViolation(allocRequestViolations, msg, a.lastCaller);
+  }
+  allocRequestRegion = ALLOC_OTHER;
+}
+
+void allocDump(Print& out) {
+  static const char* const names[ALLOC_HANDLER_FIRST] = {"other", "frame", "mode", "http"};
+  out.println(F("region                     allocs    frees    bytes     live     peak  minFreeHeap  lastCaller"));
+  for (uint8_t r = 0; r < ALLOC_REGIONS; r++) {
+    const AllocStats& a = allocStats[r];
+    const char* name = r < ALLOC_HANDLER_FIRST ? names[r] : allocHandlerUri[r - ALLOC_HANDLER_FIRST];
+    if (!*name) continue;
+    out.printf_P(PSTR("%-24s %8lu %8lu %8lu %8lu %8lu %12lu  %p\n"), name, (unsigned long)a.allocs,
+                 (unsigned long)a.frees, (unsigned long)a.bytes, (unsigned long)a.live, (unsigned long)a.peak,
+                 (unsigned long)a.minFreeHeap, a.lastCaller);
+  }
+  out.printf_P(PSTR("frame violations: %lu, request violations: %lu, heap free %lu, max block %lu, fragmentation %u%%\n"),
+               (unsigned long)allocFrameViolations, (unsigned long)allocRequestViolations,
+               (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation());
+  // 歸零計數，live 與 peak 保留（仍佔用的配置之後會被釋放）
+  for (uint8_t r = 0; r < ALLOC_REGIONS; r++) {
+    AllocStats& a = allocStats[r];
+    a.allocs = a.frees = a.bytes = a.minFreeHeap = 0;
+    a.peak = a.live;
+    a.lastCaller = nullptr;
+  }
+}
+#endif
+
+// ========== Trace 匯出 / 序列埠指令 ==========
+
+#if TRACE_ENABLED
+// 以 Chrome/Perfetto trace JSON 格式輸出環形緩衝區（chrome://tracing 或 ui.perfetto.dev 開啟）
+void traceDump(Print& out) {
+  static const char* const names[] = {"handleClient", "vibration", "updateAnimation", "show"};
+  uint32_t end = traceTotal;
+  uint32_t count = end < TRACE_RING_SIZE ? end : TRACE_RING_SIZE;
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  uint32_t base = count ? traceRing[(end - count) & (TRACE_RING_SIZE - 1)].start : 0;
+  out.print(F("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+  for (uint32_t i = end - count; i != end; i++) {
+    const TraceRecord& r = traceRing[i & (TRACE_RING_SIZE - 1)];
+    out.printf_P(PSTR("%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lu,\"dur\":%lu}\n"),
+                 i == end - count ? "" : ",", names[r.id],
+                 (unsigned long)((r.start - base) / mhz), (unsigned long)(((uint32_t)r.cycles16 << 4) / mhz));
+  }
+  out.print(F("]}\n"));
+}
+
+void handleTrace() {
+  beginRequest();
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  ChunkedResponse out;
+  traceDump(out);
+  out.finish();
+}
+#endif
+
+// 序列埠單字元指令
+void handleSerialCommand() {
+  if (!Serial.available()) return;
+  switch (Serial.read()) {
+#if TRACE_ENABLED
+    case 't':
+      traceDump(Serial);
+      break;
+#endif
+    case 'b':
+      runBenchmark();
+      break;
+#if ALLOC_TRACKING
+    case 'a':
+      allocDump(Serial);
+      break;
+#endif
+    default:
+      break;
+  }
+}
+
+// 每個 HTTP 處理函數開頭呼叫：計數並重設閒置計時
+void beginRequest() {
+  httpRequests++;
+  resetIdleTimer();
+#if ALLOC_TRACKING
+  allocBeginRequest(server.uri().c_str());
+#endif
+}
+
+// 重設閒置計時（有使用者互動時呼叫）
+void resetIdleTimer() {
+  lastActivity = millis();
+}
+
+// 切換省電階段並累計前一階段的時間
+static void idleEnter(uint8_t stage) {
+  unsigned long now = millis();
+  idleStageTotalMs[idleStage] += now - idleStageSince;
+  idleStageSince = now;
+  idleStage = stage;
+  renderAheadFlush();
+  frameIntervalMs = stage >= IDLE_LIGHT ? IDLE_LIGHT_FRAME_MS : stage >= IDLE_DIM ? IDLE_DIM_FRAME_MS : FRAME_INTERVAL_MS;
+  WiFi.setOutputPower(stage >= IDLE_RADIO ? IDLE_TX_POWER_DBM : 20.5f);
+  // 只有 follower 的 STA 介面會真正套用 modem / light sleep
+  WiFi.setSleepMode(stage >= IDLE_LIGHT ? WIFI_LIGHT_SLEEP : stage >= IDLE_RADIO ? WIFI_MODEM_SLEEP : WIFI_NONE_SLEEP);
+  Serial.print("🔋 省電階段: ");
+  Serial.println(stage);
+}
+
+// 含目前階段尚未結算的時間
+uint32_t idleStageSeconds(uint8_t stage) {
+  uint32_t ms = idleStageTotalMs[stage] + (stage == idleStage ? millis() - idleStageSince : 0);
+  return ms / 1000;
+}
+
+void idleService() {
+  if (bakeState == BAKE_RECORDING) lastActivity = millis();  // 錄製需完整幀率
+  unsigned long idle = millis() - lastActivity;
+  if (idleTimeout > 0 && idle > idleTimeout) {
+    Serial.println("🔌 閒置超時，進入深度睡眠...");
+    enterDeepSleep();
+    return;
+  }
+  uint8_t stage = IDLE_ACTIVE;
+  for (uint8_t s = IDLE_STAGES - 1; s > IDLE_ACTIVE; s--) {
+    if (idleThresholdMs[s] && idle > idleThresholdMs[s]) {
+      stage = s;
+      break;
+    }
+  }
+  if (stage != idleStage) idleEnter(stage);
+}
+
+// 檔案內容：magic(2) + version(1) + 階段數(1)，之後接各階段的閒置 ms（第 0 項為深度睡眠）
+void loadIdleConfig() {
+  File f = LittleFS.open(IDLE_FILE, "r");
+  if (!f) return;
+  uint16_t magic = 0;
+  uint8_t version = 0, stages = 0;
+  uint32_t cfg[IDLE_STAGES];
+  if (f.read((uint8_t*)&magic, sizeof(magic)) == sizeof(magic) && magic == IDLE_MAGIC &&
+      f.read(&version, 1) == 1 && version == IDLE_VERSION && f.read(&stages, 1) == 1 && stages == IDLE_STAGES &&
+      f.read((uint8_t*)cfg, sizeof(cfg)) == sizeof(cfg)) {
+    idleTimeout = cfg[0];
+    memcpy(&idleThresholdMs[1], &cfg[1], sizeof(cfg) - sizeof(cfg[0]));
+  } else {
+    Serial.println("⚠️ 省電設定格式錯誤，改用預設值");
+  }
+  f.close();
+}
+
+static void saveIdleConfig() {
+  File f = LittleFS.open(IDLE_FILE, "w");
+  if (!f) return;
+  uint16_t magic = IDLE_MAGIC;
+  uint8_t head[2] = {IDLE_VERSION, IDLE_STAGES};
+  uint32_t cfg[IDLE_STAGES] = {(uint32_t)idleTimeout, idleThresholdMs[1], idleThresholdMs[2], idleThresholdMs[3]};
+  f.write((const uint8_t*)&magic, sizeof(magic));
+  f.write(head, sizeof(head));
+  f.write((const uint8_t*)cfg, sizeof(cfg));
+  f.close();
+}
+
+// /api/idle?dim=S&radio=S&light=S&sleep=S 設定各階段的閒置秒數（0 = 略過）；回傳設定與各階段累計秒數
+void handleIdle() {
+  beginRequest();
+  static const char* const keys[IDLE_STAGES] = {"sleep", "dim", "radio", "light"};
+  bool changed = false;
+  for (uint8_t s = 0; s < IDLE_STAGES; s++) {
+    if (!server.hasArg(keys[s])) continue;
+    long seconds = server.arg(keys[s]).toInt();
+    if (seconds < 0 || seconds > 86400) {
+      server.send(400, "application/json", "{\"error\":\"seconds out of range\"}");
+      return;
+    }
+    if (s == 0) idleTimeout = seconds * 1000;
+    else idleThresholdMs[s] = seconds * 1000;
+    changed = true;
+  }
+  if (changed) saveIdleConfig();
+  String response = "{\"status\":\"ok\",\"stage\":" + String(idleStage) +
+                    ",\"sleep\":" + String(idleTimeout / 1000);
+  for (uint8_t s = 1; s < IDLE_STAGES; s++) {
+    response += ",\"" + String(keys[s]) + "\":" + String(idleThresholdMs[s] / 1000);
+  }
+  response += ",\"seconds\":[";
+  for (uint8_t s = 0; s < IDLE_STAGES; s++) {
+    if (s > 0) response += ",";
+    response += String(idleStageSeconds(s));
+  }
+  response += "]}";
+  server.send(200, "application/json", response);
 }
 
 // 進入深度睡眠（等待外部 Reset / RST 喚醒）
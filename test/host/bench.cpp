@@ -0,0 +1,38 @@
+// 主機效能比較：與序列埠指令 b 同一組項目（benchCases），以主機時鐘量測每像素 ns。
+// 主機 CPU 與 ESP8266 差很多，只看同一次執行中各項目的相對值；
+// make bench 以不同 NUM_LEDS 各編一份，比較 Effect<N> 在短燈帶（全展開）與長燈帶上的效果
+#include "../../src/main.cpp"
+#include <time.h>
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 重複執行到至少 100 ms，回傳每次呼叫的 ns
+static double timeCall(void (*fn)()) {
+  fn();
+  uint32_t calls = 1;
+  for (;;) {
+    uint64_t start = nowNs();
+    for (uint32_t i = 0; i < calls; i++) fn();
+    uint64_t elapsed = nowNs() - start;
+    if (elapsed >= 100000000) return (double)elapsed / calls;
+    calls *= 2;
+  }
+}
+
+static void compileProgram() {
+  uint8_t code[VM_CODE_MAX], len, ops;
+  int errorPos;
+  vmCompile(vmSource, code, len, ops, errorPos);
+}
+
+int main() {
+  setup();
+  printf("NUM_LEDS=%d, program \"%s\" (%u ops/pixel)\n", NUM_LEDS, vmSource, vmOpsPerPixel);
+  for (const BenchCase& c : benchCases) printf("  %-16s %8.2f ns/pixel\n", c.name, timeCall(c.fn) / NUM_LEDS);
+  printf("  %-16s %8.0f ns/program\n", "vmCompile", timeCall(compileProgram));
+  return 0;
+}
@@ -0,0 +1,560 @@
+// 玩具群模擬：每台玩具是一個行程，執行真正的 setup() / loop()，用快轉時鐘（hostFastForward）
+// 比實際時間快得多地重播數天的使用，預估電池續航並比較 idleTimeout / 省電門檻的取捨。
+//
+// 每台玩具依使用習慣產生事件（每天數次遊玩，遊玩中搖晃震動感應器；部分遊玩同時開著網頁輪詢
+// /api/status），同一組（--group）的玩具一起玩，第一台是 leader、其餘是 follower，
+// 彼此經 WiFiUdp 替身用韌體本身的同步程式對時；各台的晶振誤差隨機取 ±--ppm。
+// 韌體呼叫 ESP.deepSleep() 後該次開機結束，下一次搖晃（震動接在 RST）由乾淨的行程重新開機，
+// 只有 LittleFS 的內容（設定、播放清單、同步角色）保留下來。
+//
+// 時間只在韌體實際執行時（行程 CPU 時間 × --cpu-scale）與 delay() 時前進；
+// 同一組的行程在每次 delay() / 收封包時互相等待，落後不超過 hostUdpLatencyUs。
+// 燈帶電流由虛擬燈帶（hostShowSink）依實際送出的像素計算；MCU / WiFi 基本電流、升壓效率與電池
+// 容量是硬體假設，由參數提供（建議實測）。主機上的 FastLED fx 效果以漸層代替，
+// 那幾個模式的電流與渲染時間不具代表性。
+//
+// 用法：build/fleet_sim [--toys N] [--group N] [--days N] [--idle sleep=300&dim=60...] [--playlist]
+//                       [--mix light:0.3,normal:0.5,heavy:0.2] [--cpu-scale N] [--jobs N] [--seed N] ...
+#include "../../src/main.cpp"
+#include <atomic>
+#include <random>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <vector>
+
+static const char* const STAGE_NAMES[IDLE_STAGES] = {"active", "dim", "radio", "light"};
+#define SYNC_ERR_BUCKETS 256   // follower 效果時間誤差直方圖，每格 1 ms，最後一格為溢位
+#define SHAKE_PULSE_MS 50      // 每次搖晃讓震動腳維持 HIGH 的時間
+
+// 使用習慣：每天遊玩次數、每次平均分鐘數、遊玩中每分鐘搖晃次數、開著網頁的遊玩比例
+struct Pattern {
+  const char* name;
+  double sessions, minutes, shakesPerMinute, webShare;
+};
+static const Pattern PATTERNS[] = {
+  {"light", 2, 3.0, 2.0, 0.0},
+  {"normal", 5, 8.0, 4.0, 0.2},
+  {"heavy", 10, 15.0, 6.0, 0.4},
+};
+
+struct Options {
+  int toys = 16;
+  int group = 4;
+  int days = 1;
+  int jobs = 0;
+  uint32_t seed = 1;
+  uint32_t cpuScale = 1;
+  int ppm = 50;
+  uint16_t port = 21000;
+  uint32_t pollMs = 2000;       // 控制頁的 updateStatus 輪詢間隔
+  double webExtraMinutes = 5;   // 遊玩結束後網頁平均還開著多久
+  const char* idle = "";
+  bool playlist = false;
+  const char* mix = "light:0.3,normal:0.5,heavy:0.2";
+  double capacityMah = 1000, batteryV = 3.7, boostEfficiency = 0.85, bootMa = 75, sleepUa = 20;
+  double stageMa[IDLE_STAGES] = {75, 70, 65, 55};
+};
+static Options opt;
+
+enum EventKind : uint8_t { EVENT_SHAKE, EVENT_POLL };
+struct Event {
+  uint64_t us;
+  EventKind kind;
+};
+
+// 每台玩具的累計結果，放在共享記憶體；同一台同一時間只有一次開機在執行，直接寫入
+struct Report {
+  uint64_t stageUs[IDLE_STAGES];
+  uint64_t modeUs[MODE_COUNT];
+  double stageLedMaUs[IDLE_STAGES];
+  double modeLedMaUs[MODE_COUNT];
+  uint64_t bootUs, sleepUs;
+  uint32_t boots;
+  uint64_t modeFrames[MODE_COUNT], modeRenderUs[MODE_COUNT];
+  Histogram anim, loop, outputGap;
+  uint64_t framesRendered, framesDropped;
+  uint64_t followerUs, lockedUs;
+  uint64_t syncErr[SYNC_ERR_BUCKETS];
+  int32_t driftEstimatePpm, driftTruePpm;
+  bool driftValid, failed;
+  // 開機之間交接
+  uint64_t sleptAt, wakeAt;
+  size_t nextEvent;
+};
+
+struct Shared {
+  std::atomic<uint64_t> clock;    // 每台玩具已經跑到的快轉時間，hostOnAdvance 時更新
+  std::atomic<uint64_t> leader;   // 每組 leader 最近一次 loop() 後的（快轉 ms << 32 | effectMillis()）
+};
+
+static Shared* shared;
+static Report* reports;
+static std::vector<int32_t> toyPpm;
+
+// 目前行程代表的玩具
+static int toy, groupFirst, groupSize;
+static uint64_t endUs;
+static std::vector<Event> events;
+static Report* report;
+
+// ========== 行程間的時鐘 ==========
+
+// hostOnAdvance：公布自己的時間，等同組其他玩具都跑到 now - hostUdpLatencyUs 以後；
+// 之後它們送出的封包最早在 now 才送達，這台可以放心前進到 now
+static void fleetBarrier(uint64_t now) {
+  shared[toy].clock.store(now, std::memory_order_release);
+  uint64_t horizon = now > hostUdpLatencyUs ? now - hostUdpLatencyUs : 0;
+  for (int k = groupFirst; k < groupFirst + groupSize; k++) {
+    for (int spin = 0; shared[k].clock.load(std::memory_order_acquire) < horizon; spin++) {
+      if (spin < 100) sched_yield();
+      else usleep(50);
+    }
+  }
+}
+
+// ========== 虛擬燈帶 ==========
+
+static uint64_t sinkLastUs;
+static double sinkMa;
+static uint8_t sinkStage, sinkMode;
+
+// 上一次 show() 的電流一直維持到 untilUs
+static void sinkAccrue(uint64_t untilUs) {
+  if (untilUs <= sinkLastUs) return;
+  double maUs = sinkMa * (untilUs - sinkLastUs);
+  report->stageLedMaUs[sinkStage] += maUs;
+  report->modeLedMaUs[sinkMode] += maUs;
+  sinkLastUs = untilUs;
+}
+
+static void sinkShow(const CRGB* leds, int n) {
+  uint64_t now = hostNowUs();
+  if (idleStage == IDLE_ACTIVE && sinkLastUs) histObserve(report->outputGap, now - sinkLastUs);
+  sinkAccrue(now);
+  uint32_t duty = 0;
+  for (int i = 0; i < n; i++) duty += leds[i].r + leds[i].g + leds[i].b;
+  sinkMa = n * POWER_MA_IDLE_PER_LED + duty * (double)POWER_MA_PER_CHANNEL / 255;
+  sinkStage = idleStage;
+  sinkMode = animationMode < MODE_COUNT ? animationMode : 0;
+}
+
+// ========== 使用習慣 ==========
+
+static int poissonCount(std::mt19937_64& rng, double mean) {
+  return std::poisson_distribution<int>(mean)(rng);
+}
+
+// 同一組共用遊玩時段（groupRng），每台各自搖晃（toyRng）
+static std::vector<Event> toyEvents(const Pattern& p, uint32_t groupSeed, uint32_t toySeed) {
+  std::mt19937_64 groupRng(groupSeed), toyRng(toySeed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::vector<Event> out;
+  for (int day = 0; day < opt.days; day++) {
+    int sessions = poissonCount(groupRng, p.sessions);
+    for (int s = 0; s < sessions; s++) {
+      double start = day * 86400.0 + (8 + 13 * unit(groupRng)) * 3600;  // 08:00 - 21:00
+      double end = start + std::exponential_distribution<double>(1 / (p.minutes * 60))(groupRng);
+      std::exponential_distribution<double> gap(p.shakesPerMinute / 60);
+      for (double t = start + gap(toyRng); t < end; t += gap(toyRng)) out.push_back({(uint64_t)(t * 1e6), EVENT_SHAKE});
+      if (unit(toyRng) < p.webShare) {
+        double webEnd = end + std::exponential_distribution<double>(1 / (opt.webExtraMinutes * 60))(toyRng);
+        for (double t = start + unit(toyRng) * opt.pollMs / 1000; t < webEnd; t += opt.pollMs / 1000.0) {
+          out.push_back({(uint64_t)(t * 1e6), EVENT_POLL});
+        }
+      }
+    }
+  }
+  std::sort(out.begin(), out.end(), [](const Event& a, const Event& b) { return a.us < b.us; });
+  return out;
+}
+
+// ========== 一次開機 ==========
+
+// 從 startUs 開機，執行到深度睡眠或模擬結束；在新的子行程中執行，全域狀態都是初始值
+static void bootToy(uint64_t startUs, bool firstBoot) {
+  hostFastForward = true;
+  hostCpuScale = opt.cpuScale;
+  hostMicros = startUs;
+  hostCpuSince = hostCpuUs();
+  hostOnAdvance = fleetBarrier;
+  // 每次開機 millis() 從 0 開始，以這台的晶振誤差前進
+  hostClockPpm = toyPpm[toy];
+  hostClockOffsetUs = 0 - (startUs + (int64_t)startUs * hostClockPpm / 1000000);
+  hostShowSink = sinkShow;
+  sinkLastUs = startUs;
+  hostUdpBase = opt.port + groupFirst;
+  hostUdpNode = toy - groupFirst;
+  hostUdpNodes = groupSize;
+
+  setup();
+  report->boots++;
+  report->bootUs += hostNowUs() - startUs;
+  if (firstBoot) {
+    char uri[160];
+    if (*opt.idle) {
+      snprintf(uri, sizeof(uri), "/api/idle?%s", opt.idle);
+      server.hostRequest(uri);
+    }
+    if (groupSize > 1) {
+      server.hostRequest(toy == groupFirst ? "/api/sync?role=leader" : "/api/sync?role=follower&leader=funXled_fleet");
+    }
+    if (opt.playlist) server.hostRequest("/api/togglePlaylist");
+  }
+
+  size_t next = report->nextEvent;
+  while (next < events.size() && events[next].us < hostNowUs()) next++;  // 開機期間的事件沒有作用
+  uint64_t pinRelease = 0;
+  uint64_t now = hostNowUs();
+  bool follower = groupSize > 1 && toy != groupFirst;
+  while (now < endUs) {
+    for (; next < events.size() && events[next].us <= now; next++) {
+      if (events[next].kind == EVENT_SHAKE) {
+        hostPins[VIBRATION_PIN] = HIGH;
+        pinRelease = events[next].us + SHAKE_PULSE_MS * 1000;
+      } else {
+        server.hostEnqueue("/api/status");
+      }
+    }
+    if (pinRelease && now >= pinRelease) {
+      hostPins[VIBRATION_PIN] = LOW;
+      pinRelease = 0;
+    }
+    uint8_t stage = idleStage, mode = animationMode < MODE_COUNT ? animationMode : 0;
+    bool locked = syncClock.locked;
+    loop();
+    uint64_t after = ESP.deepSleeps ? std::min(hostNowUs(), ESP.deepSleepAt) : hostNowUs();
+    report->stageUs[stage] += after - now;
+    report->modeUs[mode] += after - now;
+    if (follower) {
+      report->followerUs += after - now;
+      if (locked) report->lockedUs += after - now;
+    }
+    now = after;
+    if (ESP.deepSleeps) break;
+
+    // 效果時間：leader 公布，follower 與 leader 的值外插到同一時刻比較
+    uint32_t nowMs = now / 1000;
+    if (groupSize > 1 && !follower) {
+      shared[groupFirst].leader.store((uint64_t)nowMs << 32 | effectMillis(), std::memory_order_relaxed);
+    } else if (follower && syncClock.locked) {
+      uint64_t sample = shared[groupFirst].leader.load(std::memory_order_relaxed);
+      int32_t behind = nowMs - (uint32_t)(sample >> 32);
+      if (sample && behind >= 0 && behind <= 50) {
+        int32_t leaderMs = (uint32_t)sample + behind + (int64_t)behind * toyPpm[groupFirst] / 1000000;
+        int32_t err = abs((int32_t)(effectMillis() - leaderMs));
+        report->syncErr[std::min(err, SYNC_ERR_BUCKETS - 1)]++;
+      }
+    }
+  }
+
+  // 結算這次開機
+  sinkAccrue(now);
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    report->modeFrames[m] += modeStats[m].frames;
+    report->modeRenderUs[m] += modeStats[m].renderUs;
+  }
+  for (uint8_t k = 0; k < HIST_BUCKETS; k++) {
+    report->anim.buckets[k] += animHist.buckets[k];
+    report->loop.buckets[k] += loopHist.buckets[k];
+  }
+  report->framesRendered += framesRendered;
+  report->framesDropped += framesDropped;
+  if (follower && syncClock.locked) {
+    report->driftValid = true;
+    report->driftEstimatePpm = syncClock.driftPpm;
+    report->driftTruePpm = toyPpm[groupFirst] - toyPpm[toy];
+  }
+
+  // 睡眠中搖晃才會重新開機，網頁輪詢連不上
+  report->sleptAt = std::min(now, endUs);
+  report->wakeAt = UINT64_MAX;
+  for (; next < events.size(); next++) {
+    if (events[next].kind == EVENT_SHAKE && events[next].us >= now) {
+      report->wakeAt = events[next].us;
+      next++;
+      break;
+    }
+  }
+  report->nextEvent = next;
+  // 睡到下次開機之前都不會送封包，其他玩具不必等
+  shared[toy].clock.store(report->wakeAt, std::memory_order_release);
+}
+
+// 一台玩具：依序以子行程執行每一次開機
+static void runToy(int index) {
+  toy = index;
+  report = &reports[toy];
+  char root[] = "/tmp/funxled-fleet-XXXXXX";
+  LittleFS.hostRoot = mkdtemp(root);
+  uint64_t t = 0;
+  for (bool first = true; t < endUs; first = false) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      bootToy(t, first);
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      report->failed = true;
+      break;
+    }
+    if (report->wakeAt >= endUs) {
+      report->sleepUs += endUs - report->sleptAt;
+      break;
+    }
+    report->sleepUs += report->wakeAt - report->sleptAt;
+    t = report->wakeAt;
+  }
+  shared[toy].clock.store(UINT64_MAX, std::memory_order_release);
+  LittleFS.hostFormat();
+  rmdir(root);
+}
+
+// ========== 統計 ==========
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)lround(p / 100 * (v.size() - 1)))];
+}
+
+// firmware 直方圖第 k 格的上限為 2^k µs
+static double histPercentileMs(const Histogram& h, double p) {
+  uint64_t total = 0, seen = 0;
+  for (uint8_t k = 0; k < HIST_BUCKETS; k++) total += h.buckets[k];
+  for (uint8_t k = 0; k < HIST_BUCKETS; k++) {
+    seen += h.buckets[k];
+    if (total && seen >= p / 100 * total) return (1u << k) / 1000.0;
+  }
+  return 0;
+}
+
+static void histAdd(Histogram& into, const Histogram& h) {
+  for (uint8_t k = 0; k < HIST_BUCKETS; k++) into.buckets[k] += h.buckets[k];
+}
+
+static double batteryMaUs(const Report& r) {
+  double ma = r.bootUs * opt.bootMa + r.sleepUs * opt.sleepUa / 1000;
+  for (uint8_t s = 0; s < IDLE_STAGES; s++) {
+    // 燈帶經 5V 升壓，換算成電池端電流
+    ma += r.stageUs[s] * opt.stageMa[s] + r.stageLedMaUs[s] * 5.0 / (opt.batteryV * opt.boostEfficiency);
+  }
+  return ma;
+}
+
+static void printSummary(double wallSeconds) {
+  std::vector<double> awakeHours, dailyMah, lifeDays, boots;
+  uint64_t stageUs[IDLE_STAGES] = {}, modeUs[MODE_COUNT] = {}, modeFrames[MODE_COUNT] = {}, modeRenderUs[MODE_COUNT] = {};
+  uint64_t rendered = 0, dropped = 0, followerUs = 0, lockedUs = 0, syncErr[SYNC_ERR_BUCKETS] = {};
+  double modeLed[MODE_COUNT] = {}, modeMah[MODE_COUNT] = {};
+  Histogram anim = {}, loopBusy = {}, gaps = {};
+  double driftErr = 0, driftErrMax = 0;
+  int driftCount = 0, failed = 0;
+  for (int i = 0; i < opt.toys; i++) {
+    const Report& r = reports[i];
+    if (r.failed) failed++;
+    uint64_t awake = r.bootUs;
+    for (uint8_t s = 0; s < IDLE_STAGES; s++) {
+      awake += r.stageUs[s];
+      stageUs[s] += r.stageUs[s];
+    }
+    double mah = batteryMaUs(r) / 3.6e9;
+    awakeHours.push_back(awake / 3.6e9 / opt.days);
+    dailyMah.push_back(mah / opt.days);
+    lifeDays.push_back(opt.capacityMah / std::max(mah / opt.days, 1e-9));
+    boots.push_back((double)r.boots / opt.days);
+    for (uint8_t m = 0; m < MODE_COUNT; m++) {
+      modeUs[m] += r.modeUs[m];
+      modeLed[m] += r.modeLedMaUs[m];
+      modeFrames[m] += r.modeFrames[m];
+      modeRenderUs[m] += r.modeRenderUs[m];
+    }
+    histAdd(anim, r.anim);
+    histAdd(loopBusy, r.loop);
+    histAdd(gaps, r.outputGap);
+    rendered += r.framesRendered;
+    dropped += r.framesDropped;
+    followerUs += r.followerUs;
+    lockedUs += r.lockedUs;
+    for (int k = 0; k < SYNC_ERR_BUCKETS; k++) syncErr[k] += r.syncErr[k];
+    if (r.driftValid) {
+      double e = abs(r.driftEstimatePpm - r.driftTruePpm);
+      driftErr += e;
+      driftErrMax = std::max(driftErrMax, e);
+      driftCount++;
+    }
+  }
+  // 各模式的燈帶能量佔比（電池端），MCU 基本電流不分模式
+  double ledTotal = 0;
+  for (uint8_t m = 0; m < MODE_COUNT; m++) ledTotal += modeLed[m];
+  for (uint8_t m = 0; m < MODE_COUNT; m++) modeMah[m] = ledTotal ? modeLed[m] / ledTotal : 0;
+
+  double simulated = (double)opt.toys * opt.days * 86400;
+  printf("\nfleet: %d toys x %d days, groups of %d, idle=%s playlist=%s cpu-scale=%u  (%.0fx real time, %.1f s)\n",
+         opt.toys, opt.days, opt.group, *opt.idle ? opt.idle : "default", opt.playlist ? "on" : "off", opt.cpuScale,
+         simulated / std::max(wallSeconds, 1e-9), wallSeconds);
+  if (failed) printf("  %d toys failed (see stderr)\n", failed);
+  printf("  awake h/day  p10 %.2f  p50 %.2f  p90 %.2f   boots/day p50 %.1f\n", percentile(awakeHours, 10),
+         percentile(awakeHours, 50), percentile(awakeHours, 90), percentile(boots, 50));
+  printf("  mAh/day      p10 %.0f  p50 %.0f  p90 %.0f\n", percentile(dailyMah, 10), percentile(dailyMah, 50),
+         percentile(dailyMah, 90));
+  printf("  battery days p10 %.1f  p50 %.1f  p90 %.1f  (%.0f mAh)\n", percentile(lifeDays, 10),
+         percentile(lifeDays, 50), percentile(lifeDays, 90), opt.capacityMah);
+  uint64_t awakeTotal = 0;
+  for (uint8_t s = 0; s < IDLE_STAGES; s++) awakeTotal += stageUs[s];
+  printf("  awake by stage");
+  for (uint8_t s = 0; s < IDLE_STAGES; s++) printf("  %s %.1f%%", STAGE_NAMES[s], 100.0 * stageUs[s] / std::max<uint64_t>(awakeTotal, 1));
+  printf("\n  frame time   render p50 <= %.3f ms  p99 <= %.3f ms   loop busy p99 <= %.3f ms   dropped %.2f%% of %llu frames\n",
+         histPercentileMs(anim, 50), histPercentileMs(anim, 99), histPercentileMs(loopBusy, 99),
+         100.0 * dropped / std::max<uint64_t>(rendered + dropped, 1), (unsigned long long)rendered);
+  printf("  output gap   (active) p50 <= %.2f ms  p99 <= %.2f ms  max <= %.2f ms\n", histPercentileMs(gaps, 50),
+         histPercentileMs(gaps, 99), histPercentileMs(gaps, 100));
+  if (opt.group > 1) {
+    uint64_t samples = 0, seen = 0;
+    int p50 = 0, p99 = 0, worst = 0;
+    for (int k = 0; k < SYNC_ERR_BUCKETS; k++) samples += syncErr[k];
+    for (int k = 0; k < SYNC_ERR_BUCKETS; k++) {
+      seen += syncErr[k];
+      if (syncErr[k]) worst = k;
+      if (!p50 && seen * 2 >= samples) p50 = k;
+      if (!p99 && seen * 100 >= samples * 99) p99 = k;
+    }
+    printf("  sync         locked %.1f%% of follower awake time  |effect error| p50 %d ms  p99 %d ms  max %d%s ms\n",
+           100.0 * lockedUs / std::max<uint64_t>(followerUs, 1), p50, p99, worst, worst == SYNC_ERR_BUCKETS - 1 ? "+" : "");
+    if (driftCount) {
+      printf("  drift        estimate vs actual crystal difference: mean %.1f ppm  max %.1f ppm (%d followers)\n",
+             driftErr / driftCount, driftErrMax, driftCount);
+    }
+  }
+  // LED mA 與 energy% 來自虛擬燈帶；渲染時間為韌體 modeStats（只統計 active 階段的幀）
+  printf("  %4s %7s %10s %13s %11s\n", "mode", "time%", "avg LED mA", "avg render ms", "LED energy%");
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    if (!modeUs[m]) continue;
+    printf("  %4u %7.1f %10.0f %13.2f %11.1f\n", m, 100.0 * modeUs[m] / std::max<uint64_t>(awakeTotal, 1),
+           modeLed[m] / modeUs[m], modeFrames[m] ? modeRenderUs[m] / 1000.0 / modeFrames[m] : 0.0, 100 * modeMah[m]);
+  }
+}
+
+// ========== 參數 ==========
+
+static void usage() {
+  fprintf(stderr,
+          "usage: fleet_sim [--toys N] [--group N] [--days N] [--jobs N] [--seed N]\n"
+          "                 [--idle QUERY]        /api/idle parameters, e.g. sleep=300&dim=60\n"
+          "                 [--playlist]          enable the firmware playlist\n"
+          "                 [--mix light:W,normal:W,heavy:W] [--poll-ms N]\n"
+          "                 [--cpu-scale N]       firmware run time multiplier (device vs host)\n"
+          "                 [--ppm N]             crystal error range +-N ppm\n"
+          "                 [--capacity-mah X] [--battery-v X] [--boost-efficiency X]\n"
+          "                 [--boot-ma X] [--stage-ma A,D,R,L] [--sleep-ua X] [--port N]\n");
+  exit(2);
+}
+
+static void parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    if (!strcmp(a, "--playlist")) {
+      opt.playlist = true;
+      continue;
+    }
+    if (i + 1 >= argc) usage();
+    const char* v = argv[++i];
+    if (!strcmp(a, "--toys")) opt.toys = atoi(v);
+    else if (!strcmp(a, "--group")) opt.group = atoi(v);
+    else if (!strcmp(a, "--days")) opt.days = atoi(v);
+    else if (!strcmp(a, "--jobs")) opt.jobs = atoi(v);
+    else if (!strcmp(a, "--seed")) opt.seed = atoi(v);
+    else if (!strcmp(a, "--idle")) opt.idle = v;
+    else if (!strcmp(a, "--mix")) opt.mix = v;
+    else if (!strcmp(a, "--poll-ms")) opt.pollMs = atoi(v);
+    else if (!strcmp(a, "--cpu-scale")) opt.cpuScale = atoi(v);
+    else if (!strcmp(a, "--ppm")) opt.ppm = atoi(v);
+    else if (!strcmp(a, "--port")) opt.port = atoi(v);
+    else if (!strcmp(a, "--capacity-mah")) opt.capacityMah = atof(v);
+    else if (!strcmp(a, "--battery-v")) opt.batteryV = atof(v);
+    else if (!strcmp(a, "--boost-efficiency")) opt.boostEfficiency = atof(v);
+    else if (!strcmp(a, "--boot-ma")) opt.bootMa = atof(v);
+    else if (!strcmp(a, "--sleep-ua")) opt.sleepUa = atof(v);
+    else if (!strcmp(a, "--stage-ma")) {
+      if (sscanf(v, "%lf,%lf,%lf,%lf", &opt.stageMa[0], &opt.stageMa[1], &opt.stageMa[2], &opt.stageMa[3]) != IDLE_STAGES) usage();
+    } else usage();
+  }
+  if (opt.toys < 1 || opt.days < 1 || opt.cpuScale < 1) usage();
+  opt.group = constrain(opt.group, 1, std::min(opt.toys, 250));
+  if (opt.jobs < 1) opt.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// 依 --mix 的比例為每組挑一種使用習慣
+static const Pattern& pickPattern(std::mt19937_64& rng) {
+  std::vector<const Pattern*> patterns;
+  std::vector<double> weights;
+  for (const char* p = opt.mix; *p;) {
+    const char* end = strchrnul(p, ',');
+    const char* colon = (const char*)memchr(p, ':', end - p);
+    size_t len = (colon ? colon : end) - p;
+    const Pattern* found = nullptr;
+    for (const Pattern& pat : PATTERNS) {
+      if (strlen(pat.name) == len && !strncmp(pat.name, p, len)) found = &pat;
+    }
+    if (!found) usage();
+    patterns.push_back(found);
+    weights.push_back(colon ? atof(colon + 1) : 1);
+    p = *end ? end + 1 : end;
+  }
+  if (patterns.empty()) usage();
+  return *patterns[std::discrete_distribution<size_t>(weights.begin(), weights.end())(rng)];
+}
+
+int main(int argc, char** argv) {
+  parseArgs(argc, argv);
+  endUs = (uint64_t)opt.days * 86400 * 1000000;
+  size_t bytes = sizeof(Shared) * opt.toys + sizeof(Report) * opt.toys;
+  void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  shared = (Shared*)mem;
+  reports = (Report*)(shared + opt.toys);
+
+  std::mt19937_64 rng(opt.seed);
+  std::uniform_int_distribution<int32_t> ppm(-opt.ppm, opt.ppm);
+  for (int i = 0; i < opt.toys; i++) toyPpm.push_back(ppm(rng));
+
+  // 同一組必須同時執行；一次啟動的玩具數不超過 --jobs（至少一組）
+  uint64_t started = hostMonotonicUs();
+  int running = 0;
+  for (int first = 0; first < opt.toys || running;) {
+    if (first < opt.toys && (running == 0 || running + opt.group <= opt.jobs)) {
+      const Pattern& pattern = pickPattern(rng);
+      uint32_t groupSeed = rng();
+      int size = std::min(opt.group, opt.toys - first);
+      for (int i = first; i < first + size; i++) {
+        uint32_t toySeed = rng();
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+          groupFirst = first;
+          groupSize = size;
+          events = toyEvents(pattern, groupSeed, toySeed);
+          runToy(i);
+          _exit(0);
+        }
+        if (pid > 0) {
+          running++;
+        } else {
+          reports[i].failed = true;
+          shared[i].clock.store(UINT64_MAX);
+        }
+      }
+      first += size;
+      continue;
+    }
+    if (wait(nullptr) > 0) running--;
+  }
+  printSummary((hostMonotonicUs() - started) / 1e6);
+  return 0;
+}
@@ -0,0 +1,19 @@
+// 主機上執行的玩具：以實際時間跑 setup() / loop()，stub server 在 127.0.0.1 上接受 HTTP 連線，
+// 讓 tools/http_load.py 不用實機也能量測延遲、吞吐量與負載下的漏幀。
+// 用法：build/host_server [port] [seconds]，seconds 為 0 時一直執行
+#include "../../src/main.cpp"
+
+int main(int argc, char** argv) {
+  uint16_t port = argc > 1 ? atoi(argv[1]) : 8080;
+  uint32_t seconds = argc > 2 ? atoi(argv[2]) : 0;
+  hostRealtime = true;
+  hostMicros = 0 - hostMonotonicUs();  // millis() 從 0 開始
+  if (!server.hostListen(port)) {
+    fprintf(stderr, "cannot listen on 127.0.0.1:%u\n", port);
+    return 1;
+  }
+  setup();
+  fprintf(stderr, "funXled host server on http://127.0.0.1:%u/\n", port);
+  while (!seconds || millis() < seconds * 1000UL) loop();
+  return 0;
+}
@@ -0,0 +1,114 @@
+// 主機測試的共用工具：TEST 註冊、CHECK 巨集、解析 stub server 記錄下來的 HTTP 回應。
+// 每個測試檔 #include "../../src/main.cpp"，main() 先呼叫 setup() 再依序執行所有 TEST
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <ESP8266WiFi.h>
+
+struct HostTest {
+  const char* name;
+  void (*fn)();
+};
+inline std::vector<HostTest>& hostTests() {
+  static std::vector<HostTest> tests;
+  return tests;
+}
+inline int hostFailures = 0;
+
+#define TEST(name)                                                                  \
+  static void name();                                                               \
+  static const bool name##_registered = (hostTests().push_back({#name, name}), true); \
+  static void name()
+
+#define CHECK(cond)                                                             \
+  do {                                                                          \
+    if (!(cond)) {                                                              \
+      hostFailures++;                                                           \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);  \
+    }                                                                           \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                                          \
+  do {                                                                                          \
+    long long va_ = (long long)(a), vb_ = (long long)(b);                                       \
+    if (va_ != vb_) {                                                                           \
+      hostFailures++;                                                                           \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, \
+              #b, va_, vb_);                                                                    \
+    }                                                                                           \
+  } while (0)
+
+// 依註冊順序執行；任一 CHECK 失敗時回傳 1
+inline int hostRunTests() {
+  for (const HostTest& t : hostTests()) {
+    int before = hostFailures;
+    t.fn();
+    printf("%-40s %s\n", t.name, hostFailures == before ? "ok" : "FAIL");
+  }
+  printf("%zu tests, %d failed checks\n", hostTests().size(), hostFailures);
+  return hostFailures ? 1 : 0;
+}
+
+// 一個 HTTP 回應：wire 為連線上實際送出的位元組，body 已去掉 chunked 框架
+struct HostResponse {
+  int status = 0;
+  std::string headers;
+  std::string body;
+  size_t wireBytes = 0;
+  size_t writes = 0;
+  bool chunked = false;
+  bool complete = false;  // Content-Length 相符，或 chunked 已收到結尾區塊
+
+  std::string header(const char* name) const {
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t p = headers.find(key);
+    if (p == std::string::npos) return "";
+    p += key.size();
+    return headers.substr(p, headers.find("\r\n", p) - p);
+  }
+};
+
+inline HostResponse hostParse(const HostConnection& conn) {
+  HostResponse r;
+  r.wireBytes = conn.out.size();
+  r.writes = conn.writes;
+  size_t end = conn.out.find("\r\n\r\n");
+  if (end == std::string::npos || conn.out.compare(0, 9, "HTTP/1.1 ") != 0) return r;
+  r.status = atoi(conn.out.c_str() + 9);
+  r.headers = conn.out.substr(0, end + 2);
+  std::string rest = conn.out.substr(end + 4);
+  r.chunked = r.header("Transfer-Encoding") == "chunked";
+  if (!r.chunked) {
+    r.body = rest;
+    r.complete = r.header("Content-Length") == std::to_string(rest.size());
+    return r;
+  }
+  size_t p = 0;
+  while (p < rest.size()) {
+    size_t eol = rest.find("\r\n", p);
+    if (eol == std::string::npos) break;
+    size_t len = strtoul(rest.c_str() + p, nullptr, 16);
+    if (len == 0) {
+      r.complete = rest.compare(eol, 4, "\r\n\r\n") == 0 && eol + 4 == rest.size();
+      break;
+    }
+    if (eol + 2 + len + 2 > rest.size() || rest.compare(eol + 2 + len, 2, "\r\n") != 0) break;
+    r.body.append(rest, eol + 2, len);
+    p = eol + 2 + len + 2;
+  }
+  return r;
+}
+
+// 以 loop() 驅動韌體直到經過 ms（loop() 結尾的 delay() 推進測試時鐘）
+inline void hostRunFor(uint32_t ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) loop();
+}
+
+// 把請求排進 stub server，跑 loop() 直到它被 handleClient() 處理
+inline HostResponse hostServe(const char* uri) {
+  auto conn = server.hostEnqueue(uri);
+  for (int i = 0; i < 10 && conn->out.empty(); i++) loop();
+  return hostParse(*conn);
+}
@@ -0,0 +1,356 @@
+// 主機測試用的 Arduino 核心替身：只實作 src/main.cpp 用到的部分。
+// 時間由測試控制（hostAdvance），String 與 Arduino 一樣直接用 malloc / realloc / free
+#pragma once
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#define PROGMEM
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define ADC_VCC 1
+#define ADC_MODE(m) static const int hostAdcMode_ __attribute__((unused)) = m
+
+class __FlashStringHelper;
+inline uint8_t pgm_read_byte(const void* p) { return *(const uint8_t*)p; }
+inline uint16_t pgm_read_word(const void* p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t pgm_read_dword(const void* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline void* memcpy_P(void* d, const void* s, size_t n) { return memcpy(d, s, n); }
+inline size_t strlen_P(const char* s) { return strlen(s); }
+inline int strcmp_P(const char* a, const char* b) { return strcmp(a, b); }
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+// ========== 時間 ==========
+// 預設由測試推進 hostMicros；hostRealtime 時改用系統單調時鐘加上 hostMicros 當作開機時間差，
+// 多個行程（多台玩具）各自有不同的 millis()，但以同一個實際時間前進。
+// hostFastForward（fleet_sim 用）時不等待：時間在程式執行時依行程 CPU 時間 × hostCpuScale 前進，
+// delay() 直接跳過；跳動前呼叫 hostOnAdvance，讓多個行程的時鐘互相等待。
+// millis() / micros() 另外加上每台玩具的開機時間差與晶振誤差（hostClockOffsetUs / hostClockPpm）
+inline uint64_t hostMicros = 0;
+inline bool hostRealtime = false;
+inline bool hostFastForward = false;
+inline uint32_t hostCpuScale = 1;
+inline uint64_t hostCpuSince = 0;
+inline void (*hostOnAdvance)(uint64_t now) = nullptr;
+inline uint64_t hostClockOffsetUs = 0;
+inline int32_t hostClockPpm = 0;
+inline uint64_t hostMonotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+inline uint64_t hostCpuUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+inline uint64_t hostNowUs() {
+  if (hostRealtime) return hostMonotonicUs() + hostMicros;
+  if (hostFastForward) return hostMicros + (hostCpuUs() - hostCpuSince) * hostCpuScale;
+  return hostMicros;
+}
+// 快轉：把到目前為止的執行時間併入 hostMicros 再前進 us；us 為 0 時只與其他行程對齊
+inline void hostFastForwardBy(uint64_t us) {
+  hostMicros = hostNowUs() + us;
+  if (hostOnAdvance) hostOnAdvance(hostMicros);
+  hostCpuSince = hostCpuUs();
+}
+inline uint64_t hostLocalUs() {
+  uint64_t t = hostNowUs();
+  return hostClockOffsetUs + t + (int64_t)t * hostClockPpm / 1000000;
+}
+inline void hostAdvance(uint32_t ms) { hostMicros += (uint64_t)ms * 1000; }
+inline void hostAdvanceUs(uint32_t us) { hostMicros += us; }
+inline unsigned long millis() { return (unsigned long)(uint32_t)(hostLocalUs() / 1000); }
+inline unsigned long micros() { return (unsigned long)(uint32_t)hostLocalUs(); }
+inline void delay(unsigned long ms) {
+  if (hostRealtime) usleep(ms * 1000);
+  else if (hostFastForward) hostFastForwardBy((uint64_t)ms * 1000);
+  else hostAdvance(ms);
+}
+inline void delayMicroseconds(unsigned int us) {
+  if (hostRealtime) usleep(us);
+  else if (hostFastForward) hostFastForwardBy(us);
+  else hostAdvanceUs(us);
+}
+inline void yield() {}
+
+// ========== GPIO（震動感應器由測試設定） ==========
+inline uint8_t hostPins[32];
+inline int digitalRead(uint8_t pin) { return hostPins[pin & 31]; }
+inline void digitalWrite(uint8_t pin, uint8_t v) { hostPins[pin & 31] = v; }
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline long random(long hi) { return hi > 0 ? ::random() % hi : 0; }
+inline long random(long lo, long hi) { return hi > lo ? lo + ::random() % (hi - lo) : lo; }
+inline void randomSeed(unsigned long s) { srandom(s); }
+
+template <class T, class L, class H>
+auto constrain(T a, L l, H h) -> decltype(a) { return a < l ? l : (a > h ? h : a); }
+using std::min;
+using std::max;
+
+// ========== String ==========
+class String {
+ public:
+  String(const char* s = "") { assign(s ? s : "", s ? strlen(s) : 0); }
+  String(const String& o) { assign(o.c_str(), o.len); }
+  String(String&& o) noexcept : buf(o.buf), len(o.len), cap(o.cap) { o.buf = nullptr; o.len = o.cap = 0; }
+  String(const __FlashStringHelper* s) : String(reinterpret_cast<const char*>(s)) {}
+  String(char c) { char s[2] = {c, 0}; assign(s, 1); }
+  String(int v) { format("%d", v); }
+  String(unsigned int v) { format("%u", v); }
+  String(long v) { format("%ld", v); }
+  String(unsigned long v) { format("%lu", v); }
+  String(float v, unsigned char decimals = 2) { format("%.*f", decimals, (double)v); }
+  String(double v, unsigned char decimals = 2) { format("%.*f", decimals, v); }
+  ~String() { free(buf); }
+
+  String& operator=(const String& o) { if (this != &o) assign(o.c_str(), o.len); return *this; }
+  String& operator=(String&& o) noexcept { std::swap(buf, o.buf); std::swap(len, o.len); std::swap(cap, o.cap); return *this; }
+  String& operator=(const char* s) { assign(s, strlen(s)); return *this; }
+  String& operator+=(const String& o) { append(o.c_str(), o.len); return *this; }
+  String& operator+=(const char* s) { append(s, strlen(s)); return *this; }
+  String& operator+=(char c) { append(&c, 1); return *this; }
+  String& operator+=(int v) { return *this += String(v); }
+  String& operator+=(unsigned int v) { return *this += String(v); }
+  String& operator+=(long v) { return *this += String(v); }
+  String& operator+=(unsigned long v) { return *this += String(v); }
+  String& operator+=(const __FlashStringHelper* s) { return *this += reinterpret_cast<const char*>(s); }
+  template <class T> String& concat(const T& v) { return *this += v; }
+
+  friend String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+  friend String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, char b) { String r(a); r += b; return r; }
+  template <class T> friend String operator+(const String& a, T b) { String r(a); r += String(b); return r; }
+
+  const char* c_str() const { return buf ? buf : ""; }
+  unsigned int length() const { return len; }
+  bool isEmpty() const { return len == 0; }
+  char operator[](unsigned int i) const { return i < len ? buf[i] : 0; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+  bool operator==(const String& s) const { return strcmp(c_str(), s.c_str()) == 0; }
+  bool operator!=(const char* s) const { return !(*this == s); }
+  bool equals(const char* s) const { return *this == s; }
+  bool startsWith(const char* s) const { return strncmp(c_str(), s, strlen(s)) == 0; }
+  bool endsWith(const char* s) const { size_t n = strlen(s); return n <= len && strcmp(c_str() + len - n, s) == 0; }
+  int indexOf(char c, unsigned int from = 0) const {
+    for (unsigned int i = from; i < len; i++) if (buf[i] == c) return i;
+    return -1;
+  }
+  int indexOf(const char* s, unsigned int from = 0) const {
+    if (from > len) return -1;
+    const char* p = strstr(c_str() + from, s);
+    return p ? int(p - c_str()) : -1;
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (to > len) to = len;
+    if (from > to) from = to;
+    String r;
+    r.assign(c_str() + from, to - from);
+    return r;
+  }
+  String substring(unsigned int from) const { return substring(from, len); }
+  long toInt() const { return strtol(c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(c_str(), nullptr); }
+  bool reserve(unsigned int n) { return grow(n); }
+  void trim() {
+    unsigned int a = 0, b = len;
+    while (a < b && isspace((unsigned char)buf[a])) a++;
+    while (b > a && isspace((unsigned char)buf[b - 1])) b--;
+    memmove(buf ? buf : nullptr, c_str() + a, b - a);
+    len = b - a;
+    if (buf) buf[len] = 0;
+  }
+  void toLowerCase() { for (unsigned int i = 0; i < len; i++) buf[i] = tolower((unsigned char)buf[i]); }
+
+ private:
+  char* buf = nullptr;
+  unsigned int len = 0;
+  unsigned int cap = 0;
+
+  bool grow(unsigned int n) {
+    if (n < cap) return true;
+    char* p = (char*)realloc(buf, n + 1);
+    if (!p) return false;
+    buf = p;
+    cap = n + 1;
+    return true;
+  }
+  void assign(const char* s, unsigned int n) {
+    if (!grow(n)) return;
+    memmove(buf, s, n);
+    buf[n] = 0;
+    len = n;
+  }
+  void append(const char* s, unsigned int n) {
+    if (!grow(len + n)) return;
+    memmove(buf + len, s, n);
+    len += n;
+    buf[len] = 0;
+  }
+  void format(const char* fmt, ...) {
+    char tmp[48];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    assign(tmp, n < 0 ? 0 : n);
+  }
+};
+
+// ========== Print / Stream ==========
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* b, size_t n) {
+    size_t r = 0;
+    while (n--) r += write(*b++);
+    return r;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t write(const char* s, size_t n) { return write((const uint8_t*)s, n); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list ap;
+    va_start(ap, fmt);
+    size_t n = vprint(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  size_t printf_P(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    size_t n = vprint(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+  size_t print(const __FlashStringHelper* s) { return write(reinterpret_cast<const char*>(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = 10) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = 10) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = 10) { return base == 10 ? printf("%ld", v) : print((unsigned long)v, base); }
+  size_t print(unsigned long v, int base = 10) {
+    char tmp[34], *p = tmp + sizeof(tmp);
+    *--p = 0;
+    do { *--p = "0123456789abcdef"[v % base]; v /= base; } while (v);
+    return write(p);
+  }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+  template <class T> auto print(const T& v) -> decltype(v.toString(), size_t()) { return print(v.toString()); }
+  template <class T> size_t println(const T& v) { return print(v) + println(); }
+  size_t println(int v, int base) { return print(v, base) + println(); }
+  size_t println() { return write("\r\n"); }
+
+ private:
+  size_t vprint(const char* fmt, va_list ap) {
+    char tmp[256];
+    va_list copy;
+    va_copy(copy, ap);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, copy);
+    va_end(copy);
+    if (n < 0) return 0;
+    if ((size_t)n < sizeof(tmp)) return write((const uint8_t*)tmp, n);
+    std::string big(n + 1, '\0');
+    vsnprintf(&big[0], big.size(), fmt, ap);
+    return write((const uint8_t*)big.data(), n);
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  size_t readBytes(uint8_t* b, size_t n) {
+    size_t r = 0;
+    int c;
+    while (r < n && (c = read()) >= 0) b[r++] = c;
+    return r;
+  }
+  size_t readBytes(char* b, size_t n) { return readBytes((uint8_t*)b, n); }
+  String readStringUntil(char end) {
+    String r;
+    int c;
+    while ((c = read()) >= 0 && c != end) r += (char)c;
+    return r;
+  }
+};
+
+// 序列埠：capture 為 true 時輸出累積在 output（預設不累積，免得測試的記憶體統計把它算進去）；
+// 設定環境變數 HOST_SERIAL 時同時印到 stderr。輸入由測試放進 input
+class HardwareSerial : public Stream {
+ public:
+  bool capture = false;
+  std::string output;
+  std::string input;
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* b, size_t n) override {
+    if (capture) output.append((const char*)b, n);
+    if (getenv("HOST_SERIAL")) fwrite(b, 1, n, stderr);
+    return n;
+  }
+  using Print::write;
+  int available() override { return input.size(); }
+  int read() override {
+    if (input.empty()) return -1;
+    int c = (uint8_t)input[0];
+    input.erase(0, 1);
+    return c;
+  }
+  int peek() override { return input.empty() ? -1 : (uint8_t)input[0]; }
+};
+inline HardwareSerial Serial;
+
+// ========== ESP ==========
+class EspClass {
+ public:
+  uint32_t restarts = 0;
+  uint32_t deepSleeps = 0;
+  uint64_t deepSleepAt = 0;  // 最後一次 deepSleep() 時的 hostNowUs()
+  uint16_t vcc = 3300;
+  uint32_t getFreeHeap() { return 40000; }
+  uint32_t getMaxFreeBlockSize() { return 30000; }
+  uint8_t getHeapFragmentation() { return 10; }
+  uint16_t getVcc() { return vcc; }
+  uint32_t getCycleCount() { return (uint32_t)(hostLocalUs() * 80); }
+  uint8_t getCpuFreqMHz() { return 80; }
+  void deepSleep(uint64_t) {
+    deepSleeps++;
+    deepSleepAt = hostNowUs();
+  }
+  void restart() { restarts++; }
+  uint32_t getFreeSketchSpace() { return 1 << 20; }
+  uint32_t getSketchSize() { return 400000; }
+  uint32_t random() { return (uint32_t)::random(); }
+  uint32_t getChipId() { return 0x123456; }
+  void wdtFeed() {}
+  uint32_t getFlashChipRealSize() { return 4 << 20; }
+};
+inline EspClass ESP;
@@ -0,0 +1,370 @@
+// 主機測試用的 ESP8266WebServer 替身。
+// hostRequest() 解析 URI 與查詢字串後直接呼叫註冊的 handler，回應照 ESP8266WebServer 的格式
+// （狀態列、標頭、Content-Length 或 chunked 框架）寫進一條 HostConnection，測試可以檢查實際送出的位元組。
+// handler 用 server.client() 取走連線（分段回應）時，連線留給測試繼續讀。
+// hostListen() 之後 handleClient() 也接受 localhost 上的真實 TCP 連線（host_server 給 tools/http_load.py 用）
+#pragma once
+#include <ESP8266WiFi.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+#define HTTP_UPLOAD_BUFLEN 2048
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  size_t contentLength;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+class ESP8266WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  // 先保留好內部緩衝區，測試的記憶體統計才不會把它們算到第一個用到的 handler
+  explicit ESP8266WebServer(int) {
+    currentUri.reserve(64);
+    pendingHeaders.reserve(256);
+    currentArgs.reserve(16);
+    queue.reserve(16);
+  }
+
+  void on(const char* uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+  void on(const char* uri, HTTPMethod m, THandlerFunction fn) { on(uri, m, fn, nullptr); }
+  void on(const char* uri, HTTPMethod m, THandlerFunction fn, THandlerFunction upload) {
+    routes.push_back({uri, m, fn, upload});
+  }
+  void onNotFound(THandlerFunction fn) { notFound = fn; }
+  void begin() { running = true; }
+  void stop() { running = false; }
+
+  // loop() 每次呼叫時處理一個排隊中的請求
+  void handleClient() {
+    handleClientCalls++;
+    if (listenFd >= 0) hostPoll();
+    if (!running || queue.empty()) return;
+    Pending p = queue.front();
+    queue.erase(queue.begin());
+    dispatch(p.conn, p.uri, p.method, p.body);
+  }
+
+  const String& uri() { return currentUri; }
+  HTTPMethod method() { return currentMethod; }
+  int args() { return (int)currentArgs.size(); }
+  const String& arg(int i) { return i < args() ? currentArgs[i].second : empty; }
+  String argName(int i) { return i < args() ? currentArgs[i].first : String(); }
+  bool hasArg(const char* name) {
+    for (auto& a : currentArgs) if (a.first == name) return true;
+    return false;
+  }
+  const String& arg(const char* name) {
+    for (auto& a : currentArgs) if (a.first == name) return a.second;
+    return empty;
+  }
+  HTTPUpload& upload() { return currentUpload; }
+  WiFiClient& client() { return currentClient; }
+
+  // 比對測試為下一個請求設定的帳密（hostAuthUser / hostAuthPassword）
+  bool authenticate(const char* user, const char* pass) {
+    return !hostAuthUser.isEmpty() && hostAuthUser == user && hostAuthPassword == pass;
+  }
+  void requestAuthentication() {
+    sendHeader("WWW-Authenticate", "Basic realm=\"Login Required\"");
+    send(401, "text/html", "");
+  }
+
+  void setContentLength(size_t len) { contentLength = len; }
+  void sendHeader(const String& name, const String& value, bool first = false) {
+    String line = name + ": " + value + "\r\n";
+    pendingHeaders = first ? line + pendingHeaders : pendingHeaders + line;
+  }
+  void send(int code, const char* type, const String& content) { send(code, type, content.c_str(), content.length()); }
+  void send(int code, const char* type = "text/html", const char* content = "") { send(code, type, content, strlen(content)); }
+  void send(int code, const String& type, const String& content) { send(code, type.c_str(), content); }
+  void send_P(int code, PGM_P type, PGM_P content) { send(code, type, content); }
+  void send_P(int code, PGM_P type, PGM_P content, size_t len) { send(code, type, content, len); }
+  void sendContent(const String& s) { sendContent(s.c_str(), s.length()); }
+  void sendContent(const char* data, size_t len) {
+    if (chunked) {
+      char head[12];
+      int n = snprintf(head, sizeof(head), "%zx\r\n", len);
+      currentClient.write((const uint8_t*)head, n);
+      if (len) currentClient.write((const uint8_t*)data, len);
+      currentClient.write((const uint8_t*)"\r\n", 2);
+    } else if (len) {
+      currentClient.write((const uint8_t*)data, len);
+    }
+  }
+  void sendContent_P(PGM_P data) { sendContent(data, strlen(data)); }
+  void sendContent_P(PGM_P data, size_t len) { sendContent(data, len); }
+
+  // ========== 測試介面 ==========
+  String hostAuthUser;       // 下一個請求帶的 Basic 認證帳密，請求結束後清除
+  String hostAuthPassword;
+  uint32_t handleClientCalls = 0;
+
+  // 立即處理一個請求，回傳連線（out 為完整的回應位元組）
+  std::shared_ptr<HostConnection> hostRequest(const char* uri, HTTPMethod m = HTTP_GET, const char* body = "") {
+    auto conn = hostConnection();
+    dispatch(conn, uri, m, body);
+    return conn;
+  }
+  // 在 127.0.0.1:port 接受 HTTP 連線；收到完整請求後排進佇列，回應由 handleClient() 送回 socket
+  bool hostListen(uint16_t port) {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in a = {};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons(port);
+    if (listenFd < 0 || bind(listenFd, (sockaddr*)&a, sizeof(a)) != 0 || listen(listenFd, 16) != 0) {
+      if (listenFd >= 0) close(listenFd);
+      listenFd = -1;
+      return false;
+    }
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+    return true;
+  }
+  // 排進佇列，由之後的 handleClient() 處理
+  std::shared_ptr<HostConnection> hostEnqueue(const char* uri, HTTPMethod m = HTTP_GET) {
+    auto conn = hostConnection();
+    queue.push_back({conn, uri, m, ""});
+    return conn;
+  }
+  // multipart 上傳：依序以 START / WRITE... / END 呼叫上傳 handler，再呼叫完成 handler
+  std::shared_ptr<HostConnection> hostUpload(const char* uri, const char* filename, const uint8_t* data, size_t len,
+                                             bool abort = false) {
+    auto conn = hostConnection();
+    const Route* r = begin(conn, uri, HTTP_POST);
+    if (r && r->upload) {
+      currentUpload = HTTPUpload();
+      currentUpload.filename = filename;
+      currentUpload.name = "firmware";
+      currentUpload.contentLength = len;
+      currentUpload.status = UPLOAD_FILE_START;
+      r->upload();
+      for (size_t off = 0; off < len; off += HTTP_UPLOAD_BUFLEN) {
+        currentUpload.currentSize = std::min(len - off, (size_t)HTTP_UPLOAD_BUFLEN);
+        memcpy(currentUpload.buf, data + off, currentUpload.currentSize);
+        currentUpload.totalSize += currentUpload.currentSize;
+        currentUpload.status = UPLOAD_FILE_WRITE;
+        r->upload();
+      }
+      currentUpload.status = abort ? UPLOAD_FILE_ABORTED : UPLOAD_FILE_END;
+      r->upload();
+    }
+    if (r) {
+      r->fn();
+    } else {
+      send(404, "text/plain", "Not found: " + currentUri);
+    }
+    finish();
+    return conn;
+  }
+
+ private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction upload;
+  };
+  struct Pending {
+    std::shared_ptr<HostConnection> conn;
+    std::string uri;
+    HTTPMethod method;
+    std::string body;
+  };
+  struct Socket {
+    int fd;
+    std::shared_ptr<HostConnection> conn;  // 請求讀完前為空
+    std::string request;
+  };
+  std::vector<Route> routes;
+  std::vector<Pending> queue;
+  std::vector<Socket> sockets;
+  int listenFd = -1;
+  THandlerFunction notFound;
+  bool running = false;
+  String currentUri;
+  HTTPMethod currentMethod = HTTP_GET;
+  std::vector<std::pair<String, String>> currentArgs;
+  HTTPUpload currentUpload;
+  WiFiClient currentClient;
+  String pendingHeaders;
+  size_t contentLength = CONTENT_LENGTH_NOT_SET;
+  bool chunked = false;
+  String empty;
+
+  // 回應緩衝區先保留足夠空間：實機上送出的資料進 lwIP 的 pbuf，不經過 malloc
+  static std::shared_ptr<HostConnection> hostConnection() {
+    auto conn = std::make_shared<HostConnection>();
+    conn->out.reserve(64 * 1024);
+    return conn;
+  }
+
+  static String urlDecode(const std::string& s) {
+    String r;
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] == '+') {
+        r += ' ';
+      } else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+        r += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+        i += 2;
+      } else {
+        r += s[i];
+      }
+    }
+    return r;
+  }
+
+  void send(int code, const char* type, const char* content, size_t len) {
+    String head = String("HTTP/1.1 ") + code + " " + reason(code) + "\r\n";
+    if (type && *type) head += String("Content-Type: ") + type + "\r\n";
+    chunked = contentLength == CONTENT_LENGTH_UNKNOWN;
+    if (chunked) {
+      head += "Transfer-Encoding: chunked\r\n";
+    } else {
+      head += String("Content-Length: ") + (unsigned long)(contentLength == CONTENT_LENGTH_NOT_SET ? len : contentLength) + "\r\n";
+    }
+    head += pendingHeaders;
+    head += "Connection: close\r\n\r\n";
+    pendingHeaders = "";
+    currentClient.write((const uint8_t*)head.c_str(), head.length());
+    if (len) sendContent(content, len);
+  }
+
+  static const char* reason(int code) {
+    switch (code) {
+      case 200: return "OK";
+      case 204: return "No Content";
+      case 400: return "Bad Request";
+      case 401: return "Unauthorized";
+      case 403: return "Forbidden";
+      case 404: return "Not Found";
+      case 409: return "Conflict";
+      case 413: return "Payload Too Large";
+      case 500: return "Internal Server Error";
+      case 503: return "Service Unavailable";
+      case 507: return "Insufficient Storage";
+      default: return "";
+    }
+  }
+
+  const Route* begin(std::shared_ptr<HostConnection> conn, const std::string& full, HTTPMethod m) {
+    size_t q = full.find('?');
+    currentUri = full.substr(0, q).c_str();
+    currentMethod = m;
+    currentArgs.clear();
+    if (q != std::string::npos) {
+      std::string query = full.substr(q + 1);
+      size_t pos = 0;
+      while (pos <= query.size()) {
+        size_t amp = query.find('&', pos);
+        std::string kv = query.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+        if (!kv.empty()) {
+          size_t eq = kv.find('=');
+          currentArgs.push_back({urlDecode(kv.substr(0, eq)), eq == std::string::npos ? String() : urlDecode(kv.substr(eq + 1))});
+        }
+        if (amp == std::string::npos) break;
+        pos = amp + 1;
+      }
+    }
+    currentClient = WiFiClient(conn);
+    pendingHeaders = "";
+    contentLength = CONTENT_LENGTH_NOT_SET;
+    chunked = false;
+    for (auto& r : routes) {
+      if (r.uri == currentUri.c_str() && (r.method == HTTP_ANY || r.method == m)) return &r;
+    }
+    return nullptr;
+  }
+
+  // handler 結束：chunked 回應補上結尾區塊並關閉連線；連線已被 handler 取走時不動它
+  void finish() {
+    if (currentClient) {
+      if (chunked) sendContent("", 0);
+      currentClient.stop();
+    }
+    currentClient = WiFiClient();
+    hostAuthUser = "";
+    hostAuthPassword = "";
+  }
+
+  // 接受新連線、讀入請求、把回應送出去。送進 kernel 的位元組視為已確認，
+  // 所以 availableForWrite() 反映的是 socket 緩衝區還塞不下的量，慢的客戶端會讓串流停下來
+  void hostPoll() {
+    int fd;
+    while ((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      sockets.push_back({fd, nullptr, ""});
+    }
+    for (size_t i = 0; i < sockets.size();) {
+      Socket& s = sockets[i];
+      char buf[2048];
+      ssize_t n = recv(s.fd, buf, sizeof(buf), 0);
+      bool peerClosed = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+      if (n > 0 && !s.conn) {
+        s.request.append(buf, n);
+        hostParseRequest(s);
+      }
+      if (s.conn) {
+        HostConnection& c = *s.conn;
+        if (!c.out.empty()) {
+          ssize_t sent = ::send(s.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+          if (sent > 0) c.out.erase(0, sent);
+          peerClosed |= sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+        }
+        c.unacked = c.out.size();
+        if (peerClosed) c.open = false;
+      }
+      if (peerClosed || (s.conn && !s.conn->open && s.conn->out.empty())) {
+        close(s.fd);
+        sockets.erase(sockets.begin() + i);
+        continue;
+      }
+      i++;
+    }
+  }
+
+  // 請求列與標頭到齊（POST 再加上 Content-Length 長度的 body）時排進佇列
+  void hostParseRequest(Socket& s) {
+    size_t end = s.request.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    size_t sp1 = s.request.find(' '), sp2 = s.request.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos || sp2 > end) return;
+    std::string method = s.request.substr(0, sp1);
+    size_t bodyLen = 0;
+    size_t cl = s.request.find("\r\nContent-Length: ");
+    if (cl != std::string::npos && cl < end) bodyLen = strtoul(s.request.c_str() + cl + 18, nullptr, 10);
+    if (s.request.size() < end + 4 + bodyLen) return;
+    s.conn = std::make_shared<HostConnection>();
+    queue.push_back({s.conn, s.request.substr(sp1 + 1, sp2 - sp1 - 1), method == "POST" ? HTTP_POST : HTTP_GET,
+                     s.request.substr(end + 4, bodyLen)});
+  }
+
+  void dispatch(std::shared_ptr<HostConnection> conn, const std::string& uri, HTTPMethod m, const std::string& body) {
+    const Route* r = begin(conn, uri, m);
+    if (!body.empty()) currentArgs.push_back({"plain", String(body.c_str())});
+    if (r) {
+      r->fn();
+    } else if (notFound) {
+      notFound();
+    } else {
+      send(404, "text/plain", "Not found: " + currentUri);
+    }
+    finish();
+  }
+};
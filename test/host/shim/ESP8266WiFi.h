@@ -0,0 +1,91 @@
+// 主機測試用的 WiFi 替身。WiFiClient 是共用的連線物件，寫入的位元組全部保留在 out，
+// 測試據此檢查實際送出的回應（含狀態列、標頭與 chunked 框架）
+#pragma once
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <memory>
+
+enum WiFiMode_t { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP, WIFI_LIGHT_SLEEP, WIFI_MODEM_SLEEP };
+enum wl_status_t { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+
+struct HostConnection {
+  std::string out;
+  std::string in;
+  bool open = true;
+  size_t writes = 0;        // write() 呼叫次數，setNoDelay 下每次約等於一個 TCP 區段
+  size_t overruns = 0;      // 寫入超過 availableForWrite() 的次數（實機上 write() 會阻塞）
+  int window = 2920;        // TCP 送出緩衝區大小
+  int unacked = 0;          // 已寫入、對方尚未確認的位元組
+  void ack() { unacked = 0; }
+};
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(std::shared_ptr<HostConnection> c) : conn(std::move(c)) {}
+  std::shared_ptr<HostConnection> connection() const { return conn; }
+  void setSync(bool) {}
+  void setNoDelay(bool) {}
+  void setTimeout(unsigned long) {}
+  bool connected() { return conn && conn->open; }
+  explicit operator bool() { return (bool)conn; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* b, size_t n) override {
+    if (!connected()) return 0;
+    if ((int)n > conn->window - conn->unacked) conn->overruns++;
+    conn->out.append((const char*)b, n);
+    conn->writes++;
+    conn->unacked += n;
+    return n;
+  }
+  using Print::write;
+  size_t write_P(PGM_P b, size_t n) { return write((const uint8_t*)b, n); }
+  int availableForWrite() override { return connected() ? std::max(0, conn->window - conn->unacked) : 0; }
+  int available() override { return conn ? conn->in.size() : 0; }
+  int read() override {
+    if (!conn || conn->in.empty()) return -1;
+    int c = (uint8_t)conn->in[0];
+    conn->in.erase(0, 1);
+    return c;
+  }
+  void stop() {
+    if (conn) conn->open = false;
+    conn.reset();
+  }
+  IPAddress remoteIP() { return IPAddress(192, 168, 4, 2); }
+
+ private:
+  std::shared_ptr<HostConnection> conn;
+};
+
+class WiFiClass {
+ public:
+  WiFiMode_t wifiMode = WIFI_OFF;
+  wl_status_t staStatus = WL_DISCONNECTED;
+  bool mode(WiFiMode_t m) { wifiMode = m; return true; }
+  WiFiMode_t getMode() { return wifiMode; }
+  void softAPmacAddress(uint8_t* mac) { static const uint8_t m[6] = {0x5c, 0xcf, 0x7f, 0x12, 0x34, 0x56}; memcpy(mac, m, 6); }
+  bool softAP(const char*, const char* = nullptr, int = 1, int = 0, int = 4, int = 100) { return true; }
+  bool softAPConfig(IPAddress, IPAddress, IPAddress) { return true; }
+  IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+  uint8_t softAPgetStationNum() { return 1; }
+  bool softAPdisconnect(bool = false) { return true; }
+  bool disconnect(bool = false) { staStatus = WL_DISCONNECTED; return true; }
+  wl_status_t status() { return staStatus; }
+  wl_status_t begin(const char*, const char* = nullptr) { return staStatus; }
+  bool setSleepMode(WiFiSleepType_t t, uint8_t = 0) { sleepType = t; return true; }
+  WiFiSleepType_t getSleepMode() { return sleepType; }
+  void setSleep(bool) {}
+  void setOutputPower(float) {}
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress broadcastIP() { return IPAddress(127, 255, 255, 255); }
+  IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+  bool isConnected() { return staStatus == WL_CONNECTED; }
+  bool forceSleepBegin(uint32_t = 0) { return true; }
+  bool forceSleepWake() { return true; }
+
+ private:
+  WiFiSleepType_t sleepType = WIFI_NONE_SLEEP;
+};
+inline WiFiClass WiFi;
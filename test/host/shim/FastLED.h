@@ -0,0 +1,256 @@
+// 主機測試用的 FastLED 替身：數學函數與顏色型別照 FastLED 的定義實作（精度不要求逐位元相同），
+// show() 只計數，並把燈帶內容交給 hostShowSink（有設定時）
+#pragma once
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+typedef uint16_t accum88;
+#define GET_MILLIS millis
+
+inline uint8_t scale8(uint8_t i, fract8 scale) { return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8; }
+inline uint8_t scale8_video(uint8_t i, fract8 scale) { return i && scale ? (((int)i * (int)scale) >> 8) + 1 : 0; }
+inline uint16_t scale16(uint16_t i, uint16_t scale) { return ((uint32_t)i * (1 + (uint32_t)scale)) >> 16; }
+inline uint8_t qadd8(uint8_t a, uint8_t b) { unsigned t = a + b; return t > 255 ? 255 : t; }
+inline uint8_t qsub8(uint8_t a, uint8_t b) { return a > b ? a - b : 0; }
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 f) {
+  return b > a ? a + scale8(b - a, f) : a - scale8(a - b, f);
+}
+inline int16_t sin16(uint16_t theta) { return (int16_t)lround(sin(theta * (2 * M_PI / 65536.0)) * 32767); }
+inline uint8_t sin8(uint8_t theta) { return (uint8_t)lround(128 + sin(theta * (2 * M_PI / 256.0)) * 127.5 - 0.5); }
+inline uint8_t cos8(uint8_t theta) { return sin8(theta + 64); }
+inline uint8_t triwave8(uint8_t in) { if (in & 0x80) in = 255 - in; return in << 1; }
+inline uint8_t ease8InOutQuad(uint8_t i) {
+  uint8_t j = i & 0x80 ? 255 - i : i;
+  uint8_t jj = scale8(j, j);
+  uint8_t jj2 = jj << 1;
+  return i & 0x80 ? 255 - jj2 : jj2;
+}
+inline uint8_t quadwave8(uint8_t in) { return ease8InOutQuad(triwave8(in)); }
+inline uint8_t cubicwave8(uint8_t in) { return quadwave8(in); }
+
+// random8 / random16：FastLED 的線性同餘產生器
+inline uint16_t rand16seed = 1337;
+inline uint8_t random8() { rand16seed = rand16seed * 2053 + 13849; return (uint8_t)((uint8_t)rand16seed + (uint8_t)(rand16seed >> 8)); }
+inline uint8_t random8(uint8_t lim) { return (random8() * (uint16_t)lim) >> 8; }
+inline uint8_t random8(uint8_t lo, uint8_t hi) { return lo + random8(hi - lo); }
+inline uint16_t random16() { rand16seed = rand16seed * 2053 + 13849; return rand16seed; }
+inline uint16_t random16(uint16_t lim) { return ((uint32_t)random16() * lim) >> 16; }
+inline void random16_set_seed(uint16_t seed) { rand16seed = seed; }
+inline void random16_add_entropy(uint16_t e) { rand16seed += e; }
+
+inline uint16_t beat88(accum88 bpm88, uint32_t timebase = 0) { return ((GET_MILLIS() - timebase) * bpm88 * 280) >> 16; }
+inline uint16_t beat16(accum88 bpm, uint32_t timebase = 0) { return beat88(bpm < 256 ? bpm << 8 : bpm, timebase); }
+inline uint8_t beat8(accum88 bpm, uint32_t timebase = 0) { return beat16(bpm, timebase) >> 8; }
+inline uint16_t beatsin16(accum88 bpm, uint16_t lo = 0, uint16_t hi = 65535, uint32_t timebase = 0, uint16_t phase = 0) {
+  uint16_t sin = sin16(beat16(bpm, timebase) + phase) + 32768;
+  return lo + scale16(sin, hi - lo);
+}
+inline uint8_t beatsin8(accum88 bpm, uint8_t lo = 0, uint8_t hi = 255, uint32_t timebase = 0, uint8_t phase = 0) {
+  return lo + scale8(sin8(beat8(bpm, timebase) + phase), hi - lo);
+}
+
+struct CHSV {
+  uint8_t h, s, v;
+  CHSV() : h(0), s(0), v(0) {}
+  CHSV(uint8_t a, uint8_t b, uint8_t c) : h(a), s(b), v(c) {}
+};
+
+struct CRGB {
+  union {
+    struct { uint8_t r, g, b; };
+    uint8_t raw[3];
+  };
+  enum HTMLColorCode : uint32_t {
+    Black = 0x000000, White = 0xFFFFFF, Red = 0xFF0000, Green = 0x008000, Blue = 0x0000FF,
+    Cyan = 0x00FFFF, Magenta = 0xFF00FF, Yellow = 0xFFFF00, Orange = 0xFFA500, Purple = 0x800080,
+  };
+  constexpr CRGB() : r(0), g(0), b(0) {}
+  constexpr CRGB(uint8_t a, uint8_t c, uint8_t d) : r(a), g(c), b(d) {}
+  constexpr CRGB(uint32_t c) : r((c >> 16) & 0xff), g((c >> 8) & 0xff), b(c & 0xff) {}
+  constexpr CRGB(HTMLColorCode c) : r((c >> 16) & 0xff), g((c >> 8) & 0xff), b(c & 0xff) {}
+  CRGB(const CHSV& hsv) {
+    // hsv2rgb_rainbow 的簡化版：六段線性色相
+    uint8_t region = hsv.h / 43, rem = (hsv.h - region * 43) * 6;
+    uint8_t p = scale8(hsv.v, 255 - hsv.s);
+    uint8_t q = scale8(hsv.v, 255 - scale8(hsv.s, rem));
+    uint8_t t = scale8(hsv.v, 255 - scale8(hsv.s, 255 - rem));
+    switch (region) {
+      case 0: r = hsv.v; g = t; b = p; break;
+      case 1: r = q; g = hsv.v; b = p; break;
+      case 2: r = p; g = hsv.v; b = t; break;
+      case 3: r = p; g = q; b = hsv.v; break;
+      case 4: r = t; g = p; b = hsv.v; break;
+      default: r = hsv.v; g = p; b = q; break;
+    }
+  }
+  CRGB& operator+=(const CRGB& o) { r = qadd8(r, o.r); g = qadd8(g, o.g); b = qadd8(b, o.b); return *this; }
+  CRGB& operator|=(const CRGB& o) { r = std::max(r, o.r); g = std::max(g, o.g); b = std::max(b, o.b); return *this; }
+  CRGB& nscale8(uint8_t s) { r = scale8(r, s); g = scale8(g, s); b = scale8(b, s); return *this; }
+  CRGB& nscale8_video(uint8_t s) { r = scale8_video(r, s); g = scale8_video(g, s); b = scale8_video(b, s); return *this; }
+  CRGB& fadeToBlackBy(uint8_t f) { return nscale8(255 - f); }
+  uint8_t& operator[](uint8_t i) { return raw[i]; }
+  const uint8_t& operator[](uint8_t i) const { return raw[i]; }
+  bool operator==(const CRGB& o) const { return r == o.r && g == o.g && b == o.b; }
+  bool operator!=(const CRGB& o) const { return !(*this == o); }
+  explicit operator bool() const { return r || g || b; }
+};
+
+template <class T>
+struct CPixelView {
+  T* leds;
+  int len;
+  operator T*() const { return leds; }
+  T& operator[](int i) { return leds[i]; }
+};
+template <int N>
+struct CRGBArray : public CPixelView<CRGB> {
+  CRGB raw[N];
+  CRGBArray() { leds = raw; len = N; }
+  CRGB& operator[](int i) { return raw[i]; }
+  const CRGB& operator[](int i) const { return raw[i]; }
+};
+
+typedef const uint32_t TProgmemRGBPalette16[16];
+struct CRGBPalette16 {
+  CRGB entries[16];
+  CRGBPalette16() {}
+  CRGBPalette16(const TProgmemRGBPalette16& p) { *this = p; }
+  CRGBPalette16& operator=(const TProgmemRGBPalette16& p) {
+    for (int i = 0; i < 16; i++) entries[i] = CRGB(p[i]);
+    return *this;
+  }
+  bool operator==(const CRGBPalette16& o) const { return memcmp(entries, o.entries, sizeof(entries)) == 0; }
+  bool operator!=(const CRGBPalette16& o) const { return !(*this == o); }
+  CRGB& operator[](int i) { return entries[i]; }
+  const CRGB& operator[](int i) const { return entries[i]; }
+};
+enum TBlendType { NOBLEND, LINEARBLEND };
+inline const TProgmemRGBPalette16 RainbowColors_p = {
+    0xFF0000, 0xD52A00, 0xAB5500, 0xAB7F00, 0xABAB00, 0x56D500, 0x00FF00, 0x00D52A,
+    0x00AB55, 0x0056AA, 0x0000FF, 0x2A00D5, 0x5500AB, 0x7F0081, 0xAB0055, 0xD5002B};
+inline const TProgmemRGBPalette16 PartyColors_p = {
+    0x5500AB, 0x84007C, 0xB5004B, 0xE5001B, 0xE81700, 0xB84700, 0xAB7700, 0xABAB00,
+    0xAB5500, 0xDD2200, 0xF2000E, 0xC2003E, 0x8F0071, 0x5F00A1, 0x2F00D0, 0x0007F9};
+inline const TProgmemRGBPalette16 OceanColors_p = {
+    0x191970, 0x00008B, 0x191970, 0x000080, 0x00008B, 0x0000CD, 0x2E8B57, 0x008080,
+    0x5F9EA0, 0x0000FF, 0x008B8B, 0x6495ED, 0x7FFFD4, 0x2E8B57, 0x00FFFF, 0x87CEFA};
+inline const TProgmemRGBPalette16 LavaColors_p = {
+    0x000000, 0x800000, 0x000000, 0x800000, 0x8B0000, 0x800000, 0x8B0000, 0x8B0000,
+    0x8B0000, 0xFF0000, 0xFFA500, 0xFFFFFF, 0xFFA500, 0xFF0000, 0x8B0000, 0x000000};
+inline const TProgmemRGBPalette16 ForestColors_p = {
+    0x006400, 0x006400, 0x556B2F, 0x006400, 0x008000, 0x228B22, 0x6B8E23, 0x008000,
+    0x2E8B57, 0x66CDAA, 0x32CD32, 0x9ACD32, 0x90EE90, 0x7CFC00, 0x66CDAA, 0x228B22};
+inline const TProgmemRGBPalette16 CloudColors_p = {
+    0x0000FF, 0x00008B, 0x00008B, 0x00008B, 0x00008B, 0x00008B, 0x00008B, 0x00008B,
+    0x0000FF, 0x00008B, 0x87CEEB, 0x87CEEB, 0xADD8E6, 0xFFFFFF, 0xADD8E6, 0x87CEEB};
+inline const TProgmemRGBPalette16 HeatColors_p = {
+    0x000000, 0x330000, 0x660000, 0x990000, 0xCC0000, 0xFF0000, 0xFF3300, 0xFF6600,
+    0xFF9900, 0xFFCC00, 0xFFFF00, 0xFFFF33, 0xFFFF66, 0xFFFF99, 0xFFFFCC, 0xFFFFFF};
+
+inline CRGB blend(const CRGB& a, const CRGB& b, fract8 amount) {
+  return CRGB(lerp8by8(a.r, b.r, amount), lerp8by8(a.g, b.g, amount), lerp8by8(a.b, b.b, amount));
+}
+inline CRGB* blend(const CRGB* a, const CRGB* b, CRGB* out, uint16_t n, fract8 amount) {
+  for (uint16_t i = 0; i < n; i++) out[i] = blend(a[i], b[i], amount);
+  return out;
+}
+inline CRGB& nblend(CRGB& a, const CRGB& b, fract8 amount) { return a = blend(a, b, amount); }
+inline CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness = 255, TBlendType type = LINEARBLEND) {
+  CRGB c = pal[index >> 4];
+  if (type == LINEARBLEND) c = blend(c, pal[((index >> 4) + 1) & 15], (index & 15) << 4);
+  if (brightness != 255) c.nscale8_video(brightness);
+  return c;
+}
+inline void nblendPaletteTowardPalette(CRGBPalette16& cur, CRGBPalette16& target, uint8_t maxChanges) {
+  uint8_t changes = 0;
+  for (int i = 0; i < 16; i++)
+    for (int k = 0; k < 3 && changes < maxChanges; k++) {
+      uint8_t& c = cur[i][k];
+      uint8_t t = target[i][k];
+      if (c != t) { c += c < t ? 1 : -1; changes++; }
+    }
+}
+inline void fill_solid(CRGB* leds, int n, const CRGB& c) { for (int i = 0; i < n; i++) leds[i] = c; }
+inline void fill_rainbow(CRGB* leds, int n, uint8_t hue, uint8_t delta = 5) {
+  for (int i = 0; i < n; i++, hue += delta) leds[i] = CHSV(hue, 240, 255);
+}
+inline void nscale8(CRGB* leds, uint16_t n, uint8_t s) { for (uint16_t i = 0; i < n; i++) leds[i].nscale8(s); }
+inline void fadeToBlackBy(CRGB* leds, uint16_t n, uint8_t f) { nscale8(leds, n, 255 - f); }
+
+#define BINARY_DITHER 1
+#define DISABLE_DITHER 0
+#define GRB 0
+#define RGB 1
+struct WS2812B;
+class CLEDController {
+ public:
+  CRGB* leds = nullptr;
+  int count = 0;
+};
+class CFastLED {
+ public:
+  CLEDController controller;
+  uint32_t shows = 0;
+  template <class C, int P, int O>
+  CLEDController& addLeds(CRGB* leds, int n, int = 0) {
+    controller.leds = leds;
+    controller.count = n;
+    return controller;
+  }
+  void setBrightness(uint8_t b) { brightness = b; }
+  uint8_t getBrightness() { return brightness; }
+  void setDither(uint8_t) {}
+  void clear(bool show = false) {
+    fill_solid(controller.leds, controller.count, CRGB::Black);
+    if (show) this->show();
+  }
+  void show();
+  void show(uint8_t) { show(); }
+  void setCorrection(uint32_t) {}
+  void setMaxPowerInVoltsAndMilliamps(uint8_t, uint32_t) {}
+
+ private:
+  uint8_t brightness = 255;
+};
+inline CFastLED FastLED;
+// 虛擬燈帶：每次 show() 收到實際送出的像素（fleet_sim 用來記錄輸出時間與電流）
+inline void (*hostShowSink)(const CRGB* leds, int n) = nullptr;
+inline void CFastLED::show() {
+  shows++;
+  if (hostShowSink) hostShowSink(controller.leds, controller.count);
+}
+
+// FastLED 的 fx 類別：主機上只需要能呼叫 draw()，畫面用時間決定的漸層代替；
+// 測試可設定 hostFxDraw 在 draw() 內執行額外的動作（例如模擬效果內部配置記憶體）
+inline void (*hostFxDraw)() = nullptr;
+namespace fl {
+class Fx {
+ public:
+  struct DrawContext {
+    uint32_t now;
+    CRGB* leds;
+    DrawContext(uint32_t t, CRGB* l) : now(t), leds(l) {}
+  };
+  explicit Fx(uint16_t n) : numLeds(n) {}
+  virtual ~Fx() {}
+  virtual void draw(DrawContext ctx) {
+    fill_rainbow(ctx.leds, numLeds, ctx.now >> 4, 7);
+    if (hostFxDraw) hostFxDraw();
+  }
+
+ protected:
+  uint16_t numLeds;
+};
+#define HOST_FX(Name) \
+  class Name : public Fx { \
+   public: \
+    explicit Name(uint16_t n) : Fx(n) {} \
+  };
+HOST_FX(Cylon)
+HOST_FX(Fire2012)
+HOST_FX(NoiseWave)
+HOST_FX(Pacifica)
+HOST_FX(Pride2015)
+HOST_FX(TwinkleFox)
+#undef HOST_FX
+}  // namespace fl
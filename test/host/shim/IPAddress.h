@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+class IPAddress {
+ public:
+  IPAddress() : addr(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+  IPAddress(uint32_t a) : addr(a) {}
+  operator uint32_t() const { return addr; }
+  uint8_t operator[](int i) const { return addr >> (8 * i); }
+  bool isSet() const { return addr != 0; }
+  String toString() const {
+    char s[16];
+    snprintf(s, sizeof(s), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(s);
+  }
+
+ private:
+  uint32_t addr;  // 與 ESP8266 相同，第一個位元組在最低位
+};
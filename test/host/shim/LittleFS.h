@@ -0,0 +1,119 @@
+// 主機測試用的 LittleFS 替身：檔案放在 hostRoot 目錄下（預設由 HOST_FS_ROOT 或 mkdtemp 產生），
+// 可用容量由 hostCapacity 模擬
+#pragma once
+#include <Arduino.h>
+#include <dirent.h>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class File : public Stream {
+ public:
+  File() {}
+  File(FILE* fp, const char* path) : fp(fp, fclose), path(path) {}
+  explicit operator bool() const { return (bool)fp; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* b, size_t n) override { return fp ? fwrite(b, 1, n, fp.get()) : 0; }
+  using Print::write;
+  int read() override {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  int read(uint8_t* b, size_t n) { return fp ? (int)fread(b, 1, n, fp.get()) : -1; }
+  int peek() override {
+    if (!fp) return -1;
+    int c = fgetc(fp.get());
+    if (c != EOF) ungetc(c, fp.get());
+    return c == EOF ? -1 : c;
+  }
+  int available() override { return fp ? (int)(size() - position()) : 0; }
+  size_t size() const {
+    if (!fp) return 0;
+    fflush(fp.get());
+    struct stat st;
+    return fstat(fileno(fp.get()), &st) == 0 ? st.st_size : 0;
+  }
+  size_t position() const { return fp ? ftell(fp.get()) : 0; }
+  bool seek(uint32_t pos) { return fp && fseek(fp.get(), pos, SEEK_SET) == 0; }
+  void flush() override { if (fp) fflush(fp.get()); }
+  void close() { fp.reset(); }
+  const char* name() const {
+    const char* slash = strrchr(path.c_str(), '/');
+    return slash ? slash + 1 : path.c_str();
+  }
+
+ private:
+  std::shared_ptr<FILE> fp;
+  std::string path;
+};
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+class FS {
+ public:
+  std::string hostRoot;
+  size_t hostCapacity = 64 * 1024;
+  bool hostMountFails = false;
+
+  bool begin() {
+    if (hostMountFails) return false;
+    if (hostRoot.empty()) {
+      const char* env = getenv("HOST_FS_ROOT");
+      if (env) {
+        hostRoot = env;
+        ::mkdir(env, 0700);
+      } else {
+        char tmpl[] = "/tmp/funxled-fs-XXXXXX";
+        hostRoot = mkdtemp(tmpl);
+      }
+    }
+    return true;
+  }
+  // 刪除所有檔案（測試之間重設）
+  void hostFormat() {
+    DIR* d = opendir(hostRoot.c_str());
+    if (!d) return;
+    while (struct dirent* e = readdir(d)) {
+      if (e->d_name[0] != '.') unlink((hostRoot + "/" + e->d_name).c_str());
+    }
+    closedir(d);
+  }
+  bool info(FSInfo& out) {
+    out = FSInfo{hostCapacity, used(), 4096, 256, 5, 32};
+    return true;
+  }
+  File open(const char* path, const char* mode) {
+    std::string full = hostPath(path);
+    FILE* fp = fopen(full.c_str(), strcmp(mode, "r") == 0 ? "rb" : strcmp(mode, "a") == 0 ? "ab" : mode[0] == 'r' ? "r+b" : "w+b");
+    return fp ? File(fp, path) : File();
+  }
+  bool exists(const char* path) { return access(hostPath(path).c_str(), F_OK) == 0; }
+  bool remove(const char* path) { return unlink(hostPath(path).c_str()) == 0; }
+  bool rename(const char* from, const char* to) { return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0; }
+  bool mkdir(const char*) { return true; }
+
+ private:
+  std::string hostPath(const char* path) {
+    begin();
+    return hostRoot + (path[0] == '/' ? "" : "/") + path;
+  }
+  size_t used() {
+    size_t total = 0;
+    DIR* d = opendir(hostRoot.c_str());
+    if (!d) return 0;
+    while (struct dirent* e = readdir(d)) {
+      struct stat st;
+      if (e->d_name[0] != '.' && stat((hostRoot + "/" + e->d_name).c_str(), &st) == 0) total += (st.st_size + 4095) / 4096 * 4096;
+    }
+    closedir(d);
+    return total;
+  }
+};
+inline FS LittleFS;
@@ -0,0 +1,39 @@
+// 主機測試用的 Updater 替身：記錄寫入的映像大小，不做驗證
+#pragma once
+#include <Arduino.h>
+
+#define U_FLASH 0
+
+class UpdaterClass {
+ public:
+  size_t written = 0;
+  bool running = false;
+  bool finished = false;
+  bool begin(size_t, int = U_FLASH) {
+    running = true;
+    finished = false;
+    written = 0;
+    return true;
+  }
+  size_t write(uint8_t*, size_t n) {
+    if (!running) return 0;
+    written += n;
+    return n;
+  }
+  bool end(bool evenIfRemaining = false) {
+    if (!running) return false;
+    running = false;
+    finished = written > 0 || evenIfRemaining;
+    return finished;
+  }
+  bool setMD5(const char*) { return true; }
+  bool hasError() { return false; }
+  uint8_t getError() { return 0; }
+  void printError(Print& out) { out.println("no error"); }
+  bool isRunning() { return running; }
+  String md5String() { return String(); }
+  size_t progress() { return written; }
+  size_t size() { return written; }
+  void clearError() {}
+};
+inline UpdaterClass Update;
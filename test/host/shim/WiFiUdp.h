@@ -0,0 +1,130 @@
+// 主機測試用的 WiFiUDP 替身。hostUdpBase 為 0 時不模擬網路，送出的封包直接丟棄；
+// 否則每台玩具（每個行程）是一個節點，節點 k 綁在 127.0.0.1:hostUdpBase + k，
+// 虛擬位址 192.168.4.(k + 1)，送到 x.x.x.255 的封包轉給其他所有節點。
+// hostFastForward 時封包前面加上送出的時間，收到後延遲 hostUdpLatencyUs（以快轉時鐘計）才交給韌體；
+// 收封包前先呼叫 hostFastForwardBy(0)，確定其他節點已經跑到可能送出這個時間以前封包的地方
+#pragma once
+#include <deque>
+#include <ESP8266WiFi.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+inline uint16_t hostUdpBase = 0;
+inline uint8_t hostUdpNode = 0;
+inline uint8_t hostUdpNodes = 1;
+inline uint32_t hostUdpLatencyUs = 2000;
+
+class WiFiUDP : public Stream {
+ public:
+  ~WiFiUDP() { stop(); }
+  uint8_t begin(uint16_t) {
+    stop();
+    if (!hostUdpBase) return 1;
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in a = hostAddr(hostUdpNode);
+    if (fd < 0 || bind(fd, (sockaddr*)&a, sizeof(a)) != 0) {
+      stop();
+      return 0;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return 1;
+  }
+  void stop() {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  int beginPacket(IPAddress ip, uint16_t) {
+    dest = ip;
+    out.clear();
+    if (hostFastForward) {
+      uint64_t sent = hostNowUs();
+      out.append((const char*)&sent, sizeof(sent));
+    }
+    return 1;
+  }
+  int endPacket() {
+    if (fd < 0) return 1;
+    for (uint8_t k = 0; k < hostUdpNodes; k++) {
+      bool broadcast = dest[3] == 255 && k != hostUdpNode;
+      if (!broadcast && dest[3] != k + 1) continue;
+      sockaddr_in a = hostAddr(k);
+      sendto(fd, out.data(), out.size(), 0, (sockaddr*)&a, sizeof(a));
+    }
+    return 1;
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* b, size_t n) override {
+    out.append((const char*)b, n);
+    return n;
+  }
+  using Print::write;
+  int parsePacket() {
+    in.clear();
+    pos = 0;
+    if (fd < 0) return 0;
+    if (hostFastForward) return parseDelayed();
+    char buf[1500];
+    sockaddr_in from;
+    socklen_t len = sizeof(from);
+    ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (sockaddr*)&from, &len);
+    if (n <= 0) return 0;
+    in.assign(buf, n);
+    fromNode = ntohs(from.sin_port) - hostUdpBase;
+    return n;
+  }
+  int read() override { return pos < in.size() ? (uint8_t)in[pos++] : -1; }
+  int read(uint8_t* b, size_t n) {
+    n = std::min(n, in.size() - pos);
+    memcpy(b, in.data() + pos, n);
+    pos += n;
+    return n;
+  }
+  int available() override { return in.size() - pos; }
+  IPAddress remoteIP() { return IPAddress(192, 168, 4, fromNode + 1); }
+  uint16_t remotePort() { return hostUdpBase + fromNode; }
+
+ private:
+  struct Delayed {
+    uint64_t arrival;
+    uint8_t from;
+    std::string data;
+  };
+  int parseDelayed() {
+    hostFastForwardBy(0);
+    char buf[1500];
+    sockaddr_in from;
+    socklen_t len = sizeof(from);
+    ssize_t n;
+    while ((n = recvfrom(fd, buf, sizeof(buf), 0, (sockaddr*)&from, &len)) >= (ssize_t)sizeof(uint64_t)) {
+      uint64_t sent;
+      memcpy(&sent, buf, sizeof(sent));
+      pending.push_back({sent + hostUdpLatencyUs, (uint8_t)(ntohs(from.sin_port) - hostUdpBase),
+                         std::string(buf + sizeof(sent), n - sizeof(sent))});
+      len = sizeof(from);
+    }
+    uint64_t now = hostNowUs();
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+      if (it->arrival > now) continue;
+      in = std::move(it->data);
+      fromNode = it->from;
+      pending.erase(it);
+      return in.size();
+    }
+    return 0;
+  }
+  static sockaddr_in hostAddr(uint8_t node) {
+    sockaddr_in a = {};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons(hostUdpBase + node);
+    return a;
+  }
+  int fd = -1;
+  IPAddress dest;
+  std::string out, in;
+  std::deque<Delayed> pending;
+  size_t pos = 0;
+  uint8_t fromNode = 0;
+};
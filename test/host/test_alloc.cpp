@@ -0,0 +1,166 @@
+// 記憶體配置追蹤測試：以 -DALLOC_TRACKING=1 -DALLOC_STRICT=1 並 --wrap=malloc,... 編譯。
+// 會 abort() 的情境在 fork() 出的子程序內執行
+#include "../../src/main.cpp"
+#include "host_test.h"
+#include <new>
+#include <signal.h>
+#include <sys/wait.h>
+
+// 與裝置上相同，operator new / delete 經過 malloc / free，才會被 --wrap 看到
+void* operator new(size_t n) {
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static void* volatile sink;
+
+static int handlerRegion(const char* uri) {
+  for (uint8_t i = 0; i < ALLOC_HANDLER_SLOTS; i++) {
+    if (strcmp(allocHandlerUri[i], uri) == 0) return ALLOC_HANDLER_FIRST + i;
+  }
+  return -1;
+}
+
+// 在子程序執行 fn，回傳子程序是否因 abort() 結束
+static bool aborts(void (*fn)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    fn();
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+TEST(realloc_is_free_plus_alloc) {
+  uint8_t saved = allocRegion;
+  AllocStats mode0 = allocStats[ALLOC_MODE], http0 = allocStats[ALLOC_HTTP];
+  allocRegion = ALLOC_MODE;
+  sink = malloc(100);
+  allocRegion = ALLOC_HTTP;
+  sink = realloc(sink, 300);
+  const AllocStats& mode = allocStats[ALLOC_MODE];
+  const AllocStats& http = allocStats[ALLOC_HTTP];
+  CHECK_EQ(mode.allocs - mode0.allocs, 1);
+  CHECK_EQ(mode.frees - mode0.frees, 1);
+  CHECK_EQ(mode.live, mode0.live);
+  CHECK_EQ(mode.peak - mode0.live, 100);
+  CHECK_EQ(http.allocs - http0.allocs, 1);
+  CHECK_EQ(http.live - http0.live, 300);
+  // realloc(p, 0) 只算釋放，記到擁有者
+  allocRegion = ALLOC_OTHER;
+  AllocStats other0 = allocStats[ALLOC_OTHER];
+  CHECK(realloc(sink, 0) == nullptr);
+  CHECK_EQ(http.frees - http0.frees, 1);
+  CHECK_EQ(http.live, http0.live);
+  CHECK_EQ(allocStats[ALLOC_OTHER].allocs, other0.allocs);
+  CHECK_EQ(allocStats[ALLOC_OTHER].frees, other0.frees);
+  allocRegion = saved;
+}
+
+TEST(free_is_charged_to_owner) {
+  AllocStats frame0 = allocStats[ALLOC_FRAME], other0 = allocStats[ALLOC_OTHER];
+  {
+    ALLOC_SCOPE(ALLOC_FRAME);
+    sink = calloc(4, 8);
+  }
+  CHECK_EQ(allocStats[ALLOC_FRAME].live - frame0.live, 32);
+  free(sink);
+  CHECK_EQ(allocStats[ALLOC_FRAME].frees - frame0.frees, 1);
+  CHECK_EQ(allocStats[ALLOC_FRAME].live, frame0.live);
+  CHECK_EQ(allocStats[ALLOC_OTHER].frees, other0.frees);
+}
+
+TEST(foreign_pointers_pass_through) {
+  // strdup() 在 libc 內部配置，沒經過 __wrap_malloc
+  AllocStats other0 = allocStats[ALLOC_OTHER];
+  char* s = strdup("not ours");
+  free(s);
+  CHECK_EQ(allocStats[ALLOC_OTHER].frees, other0.frees);
+}
+
+TEST(requests_get_per_handler_regions) {
+  CHECK_EQ(hostServe("/api/setBrightness?value=10").status, 200);
+  CHECK_EQ(hostServe("/api/status").status, 200);
+  int brightness = handlerRegion("/api/setBrightness");
+  int status = handlerRegion("/api/status");
+  CHECK(brightness >= ALLOC_HANDLER_FIRST);
+  CHECK(status >= ALLOC_HANDLER_FIRST);
+  CHECK(brightness != status);
+  if (status < 0) return;
+  const AllocStats& s = allocStats[status];
+  uint32_t allocs = s.allocs, live = s.live;
+  // 回應格式化在堆疊上，server 組標頭的配置記到 ALLOC_HTTP：handler 本身不配置
+  for (int i = 0; i < 5; i++) CHECK_EQ(hostServe("/api/status").status, 200);
+  CHECK_EQ(s.allocs, allocs);
+  CHECK_EQ(s.live, live);
+  CHECK_EQ(s.requests, 6);
+  CHECK_EQ(allocRequestViolations, 0);
+}
+
+static const char* const hotUris[] = {
+  "/api/status", "/api/setMode?mode=3", "/api/setBrightness?value=40", "/api/setColor?r=1&g=2&b=3",
+  "/api/toggleAuto", "/api/setPalette?id=2", "/api/setPowerBudget?ma=800",
+  "/api/setMode", "/api/setColor?r=1",
+};
+
+TEST(hot_handlers_do_not_allocate) {
+  // 嚴格模式下 handler 第一次以後的任何配置都會 abort()：每個 URI 在子程序內各跑三次。
+  // 會寫檔的 handler（togglePlaylist 等）要配置 LittleFS 的 File，不在此列
+  for (const char* uri : hotUris) {
+    static const char* current;
+    current = uri;
+    bool aborted = aborts([] {
+      for (int i = 0; i < 3; i++) hostServe(current);
+    });
+    CHECK(!aborted);
+    if (aborted) printf("  %s allocates\n", uri);
+  }
+}
+
+TEST(steady_frames_do_not_allocate) {
+  setAnimationMode(MODE_CYLON);
+  hostRunFor((ALLOC_WARMUP_FRAMES + 20) * FRAME_INTERVAL_MS);
+  CHECK(framesRendered > ALLOC_WARMUP_FRAMES);
+  CHECK_EQ(allocFrameViolations, 0);
+}
+
+TEST(strict_mode_aborts_on_frame_allocation) {
+  CHECK(aborts([] {
+    hostFxDraw = [] {
+      sink = malloc(16);
+      free(sink);
+    };
+    hostRunFor(10 * FRAME_INTERVAL_MS);
+  }));
+  CHECK(!aborts([] { hostRunFor(10 * FRAME_INTERVAL_MS); }));
+}
+
+static void* leaked[4];
+static uint8_t leakCount;
+
+TEST(strict_mode_aborts_on_request_leak) {
+  server.on("/test/leak", [] {
+    beginRequest();
+    leaked[leakCount++ & 3] = malloc(32);
+    server.send(200, "text/plain", "ok");
+  });
+  // 第一次呼叫允許留下配置（延遲初始化）
+  CHECK_EQ(hostServe("/test/leak").status, 200);
+  CHECK_EQ(allocStats[handlerRegion("/test/leak")].live, 32);
+  CHECK(aborts([] { hostServe("/test/leak"); }));
+  CHECK(!aborts([] { hostServe("/api/status"); }));
+}
+
+int main() {
+  setup();
+  return hostRunTests();
+}
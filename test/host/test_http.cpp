@@ -0,0 +1,179 @@
+// HTTP handler 測試：透過 stub server 呼叫實際的 handler，檢查狀態碼、回應格式與線上位元組數
+#include "../../src/main.cpp"
+#include "host_test.h"
+
+static HostResponse get(const char* uri) { return hostParse(*server.hostRequest(uri)); }
+
+// 分離後由 streamService() 送 body：每一輪對方確認一次，模擬 TCP 視窗
+static HostResponse streamed(const std::shared_ptr<HostConnection>& conn) {
+  for (int i = 0; i < 200 && !hostParse(*conn).complete; i++) {
+    streamService();
+    conn->ack();
+  }
+  return hostParse(*conn);
+}
+
+TEST(status_is_small_json) {
+  HostResponse r = get("/api/status");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.complete);
+  CHECK(r.header("Content-Type") == "application/json");
+  CHECK(r.body.find("\"status\":\"ok\"") != std::string::npos);
+  // 網頁每 2 秒輪詢一次：整個回應（含標頭）要放得進一個 TCP 區段
+  CHECK(r.wireBytes <= 536);
+  CHECK_EQ(r.writes, 2);  // 標頭、body 各一次
+}
+
+TEST(missing_parameters_are_rejected) {
+  CHECK_EQ(get("/api/setColor?r=1&g=2").status, 400);
+  CHECK_EQ(get("/api/setMode").status, 400);
+  CHECK_EQ(get("/api/setBrightness").status, 400);
+  CHECK_EQ(get("/api/nope").status, 404);
+}
+
+TEST(set_color_and_brightness) {
+  CHECK_EQ(get("/api/setColor?r=300&g=-5&b=17").status, 200);
+  CHECK(monoColor == CRGB(255, 0, 17));
+  HostResponse r = get("/api/setBrightness?value=999");
+  CHECK_EQ(r.status, 200);
+  CHECK_EQ(ledBrightness, 255);
+}
+
+TEST(upload_palette_validation) {
+  CHECK_EQ(get("/api/uploadPalette?slot=0&colors=ff0000,00FF00,0000ff").status, 200);
+  CHECK(userPalettes[0][0] == CRGB(255, 0, 0));
+  CHECK(userPalettes[0][6] == CRGB(0, 255, 0));  // 3 色拉伸成 16 格
+  CHECK(userPalettes[0][15] == CRGB(0, 0, 255));
+  CHECK_EQ(get("/api/uploadPalette?slot=0&colors=ff0000,").status, 400);
+  CHECK_EQ(get("/api/uploadPalette?slot=0&colors=fff").status, 400);
+  CHECK_EQ(get("/api/uploadPalette?slot=0&colors=0x1234").status, 400);
+  CHECK_EQ(get("/api/uploadPalette?slot=0&colors=+12345").status, 400);
+  CHECK_EQ(get("/api/uploadPalette?slot=9&colors=ff0000").status, 400);
+  std::string many = "/api/uploadPalette?slot=1&colors=";
+  for (int i = 0; i < 17; i++) many += i ? ",123456" : "123456";
+  CHECK_EQ(get(many.c_str()).status, 400);
+}
+
+TEST(metrics_are_chunked) {
+  HostResponse r = streamed(server.hostRequest("/api/metrics"));
+  CHECK_EQ(r.status, 200);
+  CHECK(r.chunked);
+  CHECK(r.complete);
+  CHECK(r.body.find("# TYPE funxled_frames_rendered_total counter\nfunxled_frames_rendered_total ") != std::string::npos);
+  CHECK(r.body.find("funxled_http_requests_total") != std::string::npos);
+}
+
+TEST(metrics_steps_fit_and_match_stream) {
+  // 每段都不超過 STREAM_STEP_MAX；狀態不變時串流送出的內容等於逐段產生的內容
+  // （先送出請求：handler 會累加請求計數）
+  std::string body = streamed(server.hostRequest("/api/metrics")).body;
+  std::string expected;
+  for (uint16_t step = 0;; step++) {
+    uint8_t buf[1024];
+    BufferPrint out(buf, sizeof(buf));
+    if (!writeMetricsStep(out, step)) break;
+    CHECK(out.len <= STREAM_STEP_MAX);
+    expected.append((const char*)buf, out.len);
+  }
+  CHECK(expected.size() > 4000);
+  CHECK(body == expected);
+}
+
+TEST(frames_render_on_time_while_metrics_stream) {
+  // 慢速手機：送出視窗只有兩個 MSS，每幀才確認一次。整份回應分散在多幀送出，
+  // 每輪 loop() 只寫入視窗容得下的量，動畫照常每 FRAME_INTERVAL_MS 一幀
+  hostRunFor(FRAME_INTERVAL_MS * 3);
+  uint32_t dropped = framesDropped;
+  auto conn = server.hostEnqueue("/api/metrics");
+  conn->window = 1072;
+  unsigned long lastFrame = millis(), worstGap = 0, lastAck = millis();
+  uint32_t rendered = framesRendered;
+  int frames = 0;
+  for (int i = 0; i < 20000 && !hostParse(*conn).complete; i++) {
+    loop();
+    if (framesRendered != rendered) {
+      rendered = framesRendered;
+      worstGap = max(worstGap, millis() - lastFrame);
+      lastFrame = millis();
+      frames++;
+    }
+    if (millis() - lastAck >= FRAME_INTERVAL_MS) {
+      conn->ack();
+      lastAck = millis();
+    }
+  }
+  HostResponse r = hostParse(*conn);
+  CHECK(r.complete);
+  CHECK(r.body.find("funxled_uptime_seconds") != std::string::npos);
+  CHECK_EQ(conn->overruns, 0);
+  CHECK(frames >= 3);
+  CHECK(worstGap <= FRAME_INTERVAL_MS);
+  CHECK_EQ(framesDropped, dropped);
+}
+
+TEST(every_metric_has_help) {
+  std::string body = streamed(server.hostRequest("/api/metrics")).body;
+  size_t types = 0;
+  for (size_t p = body.find("# TYPE "); p != std::string::npos; p = body.find("# TYPE ", p + 1)) {
+    std::string name = body.substr(p + 7, body.find(' ', p + 7) - (p + 7));
+    CHECK(body.find("# HELP " + name + " ") != std::string::npos);
+    types++;
+  }
+  CHECK(types > 20);
+  CHECK(body.find("# HELP funxled_sync_offset_ms ") != std::string::npos);
+}
+
+TEST(root_page_streams_in_single_write_chunks) {
+  auto conn = server.hostRequest("/");
+  HostResponse r = streamed(conn);
+  CHECK_EQ(r.status, 200);
+  CHECK(r.complete);
+  CHECK_EQ(r.body.size(), sizeof(htmlPage) - 1);
+  CHECK(r.body == std::string(htmlPage));
+  CHECK_EQ(conn->overruns, 0);
+  // 標頭一次，之後每個 chunk（含框架）各一次，最後是結尾區塊
+  size_t chunks = (r.body.size() + STREAM_CHUNK - 1) / STREAM_CHUNK;
+  CHECK(r.writes <= 1 + chunks + (r.body.size() / (conn->window - 7)) + 1 + 1);
+}
+
+// 跑 loop() 直到畫面變成 color
+static void runUntilShown(CRGB color) {
+  for (int i = 0; i < 10000; i++) {
+    bool shown = true;
+    for (int k = 0; k < NUM_LEDS; k++) shown &= displayFrame[k] == color;
+    if (shown) break;
+    loop();
+  }
+}
+
+TEST(changes_show_within_one_frame) {
+  // 先讓預先渲染佇列填滿，再改顏色與模式：丟棄佇列後新畫面要在一個 FRAME_INTERVAL_MS 內顯示
+  CHECK_EQ(hostServe("/api/setColor?r=1&g=2&b=3").status, 200);
+  CHECK_EQ(hostServe("/api/setMode?mode=16").status, 200);
+  hostRunFor(FRAME_INTERVAL_MS * 6);
+  CHECK_EQ(renderQueueCount, RENDER_AHEAD_FRAMES);
+  for (int i = 0; i < 5; i++) {
+    hostRunFor(7 + i * 5);  // 在幀與幀之間的不同時間點送出請求
+    unsigned long start = millis();
+    CHECK_EQ(hostServe(i % 2 ? "/api/setColor?r=200&g=10&b=0" : "/api/setColor?r=0&g=40&b=90").status, 200);
+    runUntilShown(i % 2 ? CRGB(200, 10, 0) : CRGB(0, 40, 90));
+    CHECK(millis() - start <= FRAME_INTERVAL_MS);
+  }
+  CHECK_EQ(hostServe("/api/setMode?mode=0").status, 200);
+  hostRunFor(FRAME_INTERVAL_MS * 6);
+  unsigned long start = millis();
+  CHECK_EQ(hostServe("/api/setMode?mode=16").status, 200);
+  runUntilShown(CRGB(0, 40, 90));  // 迴圈最後一次設定的顏色
+  CHECK(millis() - start <= FRAME_INTERVAL_MS);
+}
+
+TEST(requests_reset_idle_timer) {
+  hostAdvance(5000);
+  get("/api/status");
+  CHECK_EQ(lastActivity, millis());
+}
+
+int main() {
+  setup();
+  return hostRunTests();
+}
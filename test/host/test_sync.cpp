@@ -0,0 +1,295 @@
+// 多台同步測試：先以合成的時間戳交換檢查時差估計（雜訊、離群值、millis() 回繞、漂移），
+// 再 fork 一台 leader 與兩台 follower，透過 loopback UDP 以實際時間執行 loop()，比對各台的效果時間
+#include "../../src/main.cpp"
+#include "host_test.h"
+#include <sys/wait.h>
+
+// 從 follower 本地時間 t 發起一次交換：去程 up ms、leader 處理 1 ms、回程 down ms
+static SyncSample exchange(uint32_t t, uint32_t offset, uint32_t up, uint32_t down) {
+  uint32_t t2 = t + up + offset;
+  return syncMakeSample(t, t2, t2 + 1, t + up + 1 + down);
+}
+
+// 模型在 local 時預測的 leader 時間與實際 leader 時間之差
+static int32_t clockError(const SyncClock& c, uint32_t local, uint32_t leader) {
+  return (uint32_t)(local + syncClockOffset(c, local)) - leader;
+}
+
+TEST(sample_offset_survives_wraparound) {
+  const uint32_t offsets[] = {0, 5, (uint32_t)-5, 0x7FFFFFF0, 0x80000010, 0x80000000};
+  const uint32_t starts[] = {1000, 0xFFFFFFFE, 0x7FFFFFFF};
+  for (uint32_t offset : offsets) {
+    for (uint32_t t : starts) {
+      SyncSample s = exchange(t, offset, 3, 3);
+      CHECK_EQ(s.offset, (int32_t)offset);
+      CHECK_EQ(s.rtt, 6);
+      CHECK_EQ(s.local, t + 7);
+      // 去回程不對稱時誤差為差值的一半
+      CHECK_EQ((int32_t)((uint32_t)exchange(t, offset, 11, 3).offset - offset), 4);
+    }
+  }
+}
+
+TEST(estimate_ignores_slow_exchanges) {
+  // 時差在 int32 上限附近，樣本的時差會跨過 INT32_MAX / INT32_MIN；本地時鐘也在途中回繞。
+  // 合成樣本一律每 3 秒一筆（韌體預設的 beacon 間隔），不受 -DSYNC_INTERVAL_MS 影響
+  const uint32_t offset = 0x7FFFFFFF;
+  SyncClock c = {};
+  uint32_t t = 0xFFFFC000;
+  for (int i = 0; i < 40; i++, t += 3000) {
+    uint32_t jitter = (i * 7) % 3;
+    bool outlier = i % 3 == 1;  // 排隊延遲只發生在去程：時差偏 +200 ms，往返時間也長
+    SyncSample s = outlier ? exchange(t, offset, 400, 2) : exchange(t, offset, 2 + jitter, 2);
+    bool jumped = syncEstimate(c, s);
+    CHECK_EQ(jumped, i == 0);
+    CHECK(c.locked);
+    int32_t err = clockError(c, s.local, s.local + offset);
+    CHECK(err >= -2 && err <= 2);
+  }
+  CHECK(t < 0xFFFFC000);  // 確實經過回繞
+  CHECK_EQ(c.driftPpm, 0);
+}
+
+TEST(estimate_steps_on_large_error) {
+  SyncClock c = {};
+  syncEstimate(c, exchange(5000, 1000, 2, 2));
+  CHECK(!syncEstimate(c, exchange(8000, 1000 + SYNC_STEP_MS / 2, 2, 2)));
+  CHECK(syncEstimate(c, exchange(11000, 1000 - 2 * SYNC_STEP_MS, 2, 2)));
+  CHECK_EQ(clockError(c, 11005, 11005 + 1000 - 2 * SYNC_STEP_MS), 0);
+}
+
+TEST(estimate_learns_drift) {
+  // leader 的時鐘比本地快 100 ppm
+  const uint32_t start = 0xFFFF0000, offset0 = 0x12345678;
+  auto leaderAt = [&](uint32_t local) { return local + offset0 + (uint32_t)((int64_t)(int32_t)(local - start) * 100 / 1000000); };
+  SyncClock c = {};
+  uint32_t t = start;
+  for (int i = 0; i < 200; i++, t += 3000) {
+    uint32_t offset = leaderAt(t) - t;
+    syncEstimate(c, i % 4 == 3 ? exchange(t, offset, 150, 3) : exchange(t, offset, 2 + i % 2, 2));
+  }
+  CHECK(c.driftPpm >= 70 && c.driftPpm <= 130);
+  // 停止取樣後靠漂移估計外推一分鐘
+  uint32_t later = t + 60000;
+  int32_t err = clockError(c, later, leaderAt(later));
+  CHECK(err >= -3 && err <= 3);
+}
+
+// 片段每幀只有第一個位元組不同：第 k 幀為 k + 1，解碼結果可直接看出播放到哪一幀。
+// 關鍵幀與全黑幀 XOR，其餘與上一幀 XOR；最後附上關鍵幀索引
+static void writeClip(uint8_t mode, uint16_t frames, uint16_t frameMs) {
+  File f = LittleFS.open(bakePath(mode).c_str(), "w");
+  BakeHeader h = {BAKE_MAGIC, BAKE_VERSION, mode, NUM_LEDS, BAKE_NO_PALETTE, frames, frameMs, BAKE_KEYFRAME_FRAMES};
+  f.write((const uint8_t*)&h, sizeof(h));
+  std::vector<uint32_t> keys;
+  for (uint16_t k = 0; k < frames; k++) {
+    bool key = k % BAKE_KEYFRAME_FRAMES == 0;
+    if (key) keys.push_back(f.position());
+    uint8_t xorByte = (k + 1) ^ (key ? 0 : k);
+    f.write((uint8_t)0x80);
+    f.write(xorByte);
+    for (int left = BAKE_FRAME_BYTES - 1; left > 0; left -= 128) f.write((uint8_t)(min(left, 128) - 1));
+  }
+  f.write((const uint8_t*)keys.data(), keys.size() * 4);
+  f.close();
+}
+
+TEST(baked_clip_follows_effect_time) {
+  const uint16_t frames = 7, frameMs = 40;
+  writeClip(MODE_CHASE, frames, frameMs);
+  bakeScan();
+  setAnimationMode(MODE_CHASE);
+  CRGB out[NUM_LEDS];
+  auto expected = [&] { return effectMillis() / frameMs % frames + 1; };
+  for (int i = 0; i < 20; i++) {
+    CHECK(bakeRender(out));
+    CHECK_EQ(out[0].r, expected());
+    hostAdvance(13 + i * 17);  // 不固定的幀間隔，含閒置降幀時的長間隔
+  }
+  // 鎖定 leader 的時鐘後往回跳：從頭解碼到 leader 時間對應的幀
+  syncClock = {};
+  syncEstimate(syncClock, exchange(millis(), (uint32_t)-5000, 1, 1));
+  CHECK(bakeRender(out));
+  CHECK_EQ(out[0].r, expected());
+  hostAdvance(frameMs);
+  CHECK(bakeRender(out));
+  CHECK_EQ(out[0].r, expected());
+
+  syncClock = {};
+  bakeClose();
+  LittleFS.remove(bakePath(MODE_CHASE).c_str());
+  bakeScan();
+  bakeCheckedMode = -1;
+}
+
+TEST(baked_clip_seek_decodes_one_interval) {
+  // 長片段：幀號超過 255 時第一個位元組回繞，仍可比對
+  const uint16_t frames = 1500, frameMs = 20;
+  writeClip(MODE_CHASE, frames, frameMs);
+  bakeScan();
+  setAnimationMode(MODE_CHASE);
+  CRGB out[NUM_LEDS];
+  auto expected = [&] { return (uint8_t)(effectMillis() / frameMs % frames + 1); };
+  const int32_t jumps[] = {25000, -20000, 7 * frameMs, -frameMs, 29000, 1000};
+  for (int32_t jump : jumps) {
+    syncClock = {};
+    syncEstimate(syncClock, exchange(millis(), (uint32_t)jump, 1, 1));
+    uint32_t before = bakeFramesDecoded;
+    CHECK(bakeRender(out));
+    CHECK_EQ(out[0].r, expected());
+    CHECK(bakeFramesDecoded - before <= BAKE_KEYFRAME_FRAMES);
+    hostAdvance(frameMs);
+    before = bakeFramesDecoded;
+    CHECK(bakeRender(out));
+    CHECK_EQ(out[0].r, expected());
+    CHECK_EQ(bakeFramesDecoded - before, 1u);
+  }
+
+  syncClock = {};
+  bakeClose();
+  LittleFS.remove(bakePath(MODE_CHASE).c_str());
+  bakeScan();
+  bakeCheckedMode = -1;
+}
+
+// 錄製再重播：合成幀直接交給 bakeRecordFrame()，不經過效果渲染
+static void syntheticFrame(uint16_t k, CRGB* px) {
+  for (int i = 0; i < NUM_LEDS; i++) px[i] = CRGB(k, i * 7 + k * 3, (k >> 8) + (k % 5 == 0 ? i : 0));
+}
+
+TEST(recorded_clip_plays_back_after_seeks) {
+  CHECK(bakeStart(MODE_CHASE, 2) == nullptr);
+  uint16_t target = bakeRecordTarget;
+  CRGB px[NUM_LEDS];
+  for (uint16_t k = 0; k < target; k++) {
+    syntheticFrame(k, px);
+    bakeRecordFrame(px);
+    bakeService();
+  }
+  while (bakeService()) {}
+  CHECK(bakeMask & (1UL << MODE_CHASE));
+  CHECK_EQ(bakeState, BAKE_IDLE);
+
+  CRGB out[NUM_LEDS];
+  const uint32_t offsets[] = {0, 37 * FRAME_INTERVAL_MS, 3 * FRAME_INTERVAL_MS, 90 * FRAME_INTERVAL_MS, 64 * FRAME_INTERVAL_MS};
+  for (uint32_t offset : offsets) {
+    syncClock = {};
+    syncEstimate(syncClock, exchange(millis(), offset - millis(), 1, 1));
+    for (int step = 0; step < 3; step++, hostAdvance(FRAME_INTERVAL_MS)) {
+      CHECK(bakeRender(out));
+      syntheticFrame(effectMillis() / FRAME_INTERVAL_MS % target, px);
+      CHECK(memcmp(out, px, sizeof(px)) == 0);
+    }
+  }
+
+  syncClock = {};
+  bakeClose();
+  LittleFS.remove(bakePath(MODE_CHASE).c_str());
+  bakeScan();
+  bakeCheckedMode = -1;
+}
+
+// ========== 多台玩具（多個行程）==========
+
+struct Report {
+  uint64_t mono;    // 系統單調時鐘 us，各行程共用
+  uint32_t effect;  // 該台的 effectMillis()
+  uint8_t mode;
+  bool locked;
+};
+
+// 開一台玩具：millis() 從 bootMillis 開始，透過 /api/sync 設定角色，執行 loop() 直到 until，
+// 每 5 ms 把效果時間寫進 pipe
+static pid_t spawnToy(uint8_t node, uint32_t bootMillis, const char* uri, uint64_t until, int& readFd) {
+  int fds[2];
+  if (pipe(fds) != 0) return -1;
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid != 0) {
+    close(fds[1]);
+    readFd = fds[0];
+    return pid;
+  }
+  close(fds[0]);
+  char root[] = "/tmp/funxled-sync-XXXXXX";
+  LittleFS.hostRoot = mkdtemp(root);
+  hostRealtime = true;
+  hostMicros = (uint64_t)bootMillis * 1000 - hostMonotonicUs();
+  hostUdpNode = node;
+  server.hostRequest(uri);
+  if (node == 0) server.hostRequest("/api/setMode?mode=9");
+  uint64_t nextReport = 0;
+  while (hostMonotonicUs() < until) {
+    loop();
+    if (hostMonotonicUs() >= nextReport) {
+      Report r = {hostMonotonicUs(), effectMillis(), (uint8_t)animationMode, syncClock.locked};
+      if (write(fds[1], &r, sizeof(r)) != sizeof(r)) break;
+      nextReport = r.mono + 5000;
+    }
+    usleep(500);
+  }
+  LittleFS.hostFormat();
+  rmdir(root);
+  _exit(0);
+}
+
+static std::vector<Report> collect(pid_t pid, int fd) {
+  std::vector<Report> reports;
+  Report r;
+  while (read(fd, &r, sizeof(r)) == sizeof(r)) reports.push_back(r);
+  close(fd);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return reports;
+}
+
+TEST(loopback_followers_track_leader) {
+  hostUdpBase = 20000 + getpid() % 20000;
+  hostUdpNodes = 3;
+  uint64_t until = hostMonotonicUs() + 3000000;
+  // leader 的 millis() 約 1.5 秒後回繞；兩台 follower 與 leader 的時差分別很小與接近 int32 上限
+  const uint32_t boots[] = {0xFFFFFFFF - 1500, 2000, 0x80000000 + 700};
+  const char* uris[] = {"/api/sync?role=leader", "/api/sync?role=follower&leader=funXled_000000",
+                        "/api/sync?role=follower&leader=funXled_000000"};
+  pid_t pids[3];
+  int fds[3];
+  for (int n = 0; n < 3; n++) pids[n] = spawnToy(n, boots[n], uris[n], until, fds[n]);
+  std::vector<Report> reports[3];
+  for (int n = 0; n < 3; n++) reports[n] = collect(pids[n], fds[n]);
+  hostUdpBase = 0;
+  const std::vector<Report>& leader = reports[0];
+  CHECK(leader.size() > 100);
+  if (leader.empty()) return;
+
+  for (int n = 1; n < 3; n++) {
+    const std::vector<Report>& follower = reports[n];
+    CHECK(follower.size() > 100);
+    if (follower.empty()) continue;
+    CHECK(follower.back().locked);
+    CHECK_EQ(follower.back().mode, leader.back().mode);
+    // 與最接近的 leader 回報比較，換算到同一個實際時間；鎖定後 200 ms 內允許收斂
+    size_t checked = 0, l = 0;
+    int32_t worst = 0;
+    uint64_t lockedAt = 0;
+    for (const Report& r : follower) {
+      if (!r.locked) continue;
+      if (!lockedAt) lockedAt = r.mono;
+      if (r.mono < lockedAt + 200000) continue;
+      while (l + 1 < leader.size() && leader[l + 1].mono <= r.mono) l++;
+      int64_t dt = (int64_t)(r.mono - leader[l].mono) / 1000;
+      int32_t err = r.effect - (uint32_t)(leader[l].effect + dt);
+      worst = max(worst, err < 0 ? -err : err);
+      checked++;
+    }
+    CHECK(checked > 50);
+    CHECK(worst <= 5);
+    printf("  follower %d: %zu reports, worst error %d ms\n", n, checked, (int)worst);
+  }
+}
+
+int main() {
+  setup();
+  return hostRunTests();
+}
@@ -0,0 +1,37 @@
+// Trace 環形緩衝區測試：以 -DTRACE_ENABLED=1 編譯，檢查空的 handleClient 輪詢不佔位置、
+// 緩衝區能涵蓋最近幾秒
+#include "../../src/main.cpp"
+#include "host_test.h"
+
+static uint32_t countSince(uint32_t from, uint8_t id) {
+  uint32_t n = 0;
+  for (uint32_t i = from; i != traceTotal; i++) n += traceRing[i & (TRACE_RING_SIZE - 1)].id == id;
+  return n;
+}
+
+TEST(idle_polls_are_not_traced) {
+  uint32_t from = traceTotal;
+  hostRunFor(2000);
+  CHECK_EQ(countSince(from, TRACE_HTTP), 0);
+  CHECK(countSince(from, TRACE_ANIMATION) > 0);
+  hostServe("/api/status");
+  CHECK_EQ(countSince(from, TRACE_HTTP), 1);
+}
+
+TEST(ring_covers_several_seconds) {
+  // 低亮度單色：輸出級持續抖動，show 以 OUTPUT_REFRESH_HZ 刷新，是記錄最多的情況
+  hostServe("/api/setMode?mode=16");
+  hostServe("/api/setBrightness?value=3");
+  hostRunFor(10000);
+  CHECK(traceTotal > TRACE_RING_SIZE);
+  uint32_t oldest = traceRing[traceTotal & (TRACE_RING_SIZE - 1)].start;
+  uint32_t newest = traceRing[(traceTotal - 1) & (TRACE_RING_SIZE - 1)].start;
+  uint32_t seconds = (newest - oldest) / (ESP.getCpuFreqMHz() * 1000000UL);
+  printf("  %u records cover %u s\n", TRACE_RING_SIZE, (unsigned)seconds);
+  CHECK(seconds >= 3);
+}
+
+int main() {
+  setup();
+  return hostRunTests();
+}
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+"""funXled HTTP 負載測試工具
+
+模擬多個瀏覽器同時連到玩具：每個瀏覽器像網頁一樣每 2 秒輪詢 /api/status，
+並不時拖動亮度 / 顏色滑桿（短時間內連續送出 setBrightness / setColor）。
+結束時輸出延遲 p50/p99、每秒請求數、線上位元組數（送出與收到的 TCP 資料量，由包住 socket 的
+計數器量測，不含 TCP/IP 標頭），並比對 /api/metrics
+前後的 frames_rendered / frames_dropped，得到負載期間漏掉的動畫幀數。
+
+用法：
+    python3 tools/http_load.py --host 192.168.4.1 --clients 4 --duration 30
+
+不接實機時，對主機上編譯的韌體（test/host/build/host_server，以實際時間執行 loop()）打負載：
+    make -C test/host build/host_server && test/host/build/host_server 8080 &
+    python3 tools/http_load.py --host 127.0.0.1:8080
+或直接 make -C test/host load
+"""
+
+import argparse
+import http.client
+import io
+import random
+import socket
+import threading
+import time
+
+POLL_INTERVAL = 2.0       # 與網頁 setInterval(updateStatus, 2000) 相同
+DRAG_PROBABILITY = 0.2    # 每次輪詢後開始拖動滑桿的機率
+DRAG_EVENTS = 10          # 一次拖動送出的請求數
+DRAG_INTERVAL = 0.05      # 拖動時請求間隔（秒）
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = {}
+        self.bytes_sent = 0
+        self.bytes_received = 0
+        self.errors = 0
+
+    def record(self, path, seconds, sent, received):
+        with self.lock:
+            self.latencies.setdefault(path, []).append(seconds)
+            self.bytes_sent += sent
+            self.bytes_received += received
+
+    def error(self):
+        with self.lock:
+            self.errors += 1
+
+
+class CountingSocket:
+    """包住 socket，計算實際送出與收到的位元組（http.client 經由 makefile() 讀取回應）。"""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.sent = 0
+        self.received = 0
+        self.io_refs = 0
+        self.closed = False
+
+    def sendall(self, data, *args):
+        self.sock.sendall(data, *args)
+        self.sent += len(data)
+
+    def send(self, data, *args):
+        n = self.sock.send(data, *args)
+        self.sent += n
+        return n
+
+    def recv_into(self, buffer, *args):
+        n = self.sock.recv_into(buffer, *args)
+        self.received += n
+        return n
+
+    def makefile(self, mode="rb", buffering=-1, **kwargs):
+        # SocketIO 透過 self.recv_into() 讀取，緩衝區讀到的每個位元組都會被計入
+        raw = socket.SocketIO(self, "rb")
+        self.io_refs += 1
+        return io.BufferedReader(raw, buffering if buffering > 0 else io.DEFAULT_BUFFER_SIZE)
+
+    # 與 socket.socket 相同：回應還在讀取時 close() 延後到 makefile() 的檔案關閉
+    def _decref_socketios(self):
+        self.io_refs -= 1
+        if self.closed and self.io_refs <= 0:
+            self.sock.close()
+
+    def close(self):
+        self.closed = True
+        if self.io_refs <= 0:
+            self.sock.close()
+
+    def __getattr__(self, name):
+        return getattr(self.sock, name)
+
+
+class CountingConnection(http.client.HTTPConnection):
+    def connect(self):
+        super().connect()
+        self.sock = CountingSocket(self.sock)
+        self.counter = self.sock
+
+
+def fetch(host, path, timeout):
+    """回傳 (秒數, 回應 body, 送出位元組, 收到位元組)。位元組為這條連線上實際的 TCP 資料量，
+    包含請求列、標頭與 chunked 框架。玩具每個回應都會關閉連線，所以每個請求各開一條。"""
+    conn = CountingConnection(host, timeout=timeout)
+    start = time.perf_counter()
+    try:
+        conn.request("GET", path)
+        resp = conn.getresponse()
+        body = resp.read()
+        if resp.status >= 400:
+            raise OSError("HTTP %d for %s" % (resp.status, path))
+    finally:
+        counter = getattr(conn, "counter", None)
+        conn.close()
+    return time.perf_counter() - start, body, counter.sent, counter.received
+
+
+def read_metrics(host, timeout):
+    text = fetch(host, "/api/metrics", timeout)[1].decode()
+    values = {}
+    for line in text.splitlines():
+        if line and not line.startswith("#"):
+            name, _, value = line.rpartition(" ")
+            values[name] = float(value)
+    return values
+
+
+def browser(host, stats, deadline, timeout, seed):
+    rng = random.Random(seed)
+
+    def hit(path):
+        try:
+            seconds, _, sent, received = fetch(host, path, timeout)
+            stats.record(path.split("?")[0], seconds, sent, received)
+        except (OSError, http.client.HTTPException):
+            stats.error()
+
+    hit("/")
+    while time.time() < deadline:
+        hit("/api/status")
+        if rng.random() < DRAG_PROBABILITY:
+            slider = rng.choice(("brightness", "color"))
+            for _ in range(DRAG_EVENTS):
+                if slider == "brightness":
+                    hit("/api/setBrightness?value=%d" % rng.randrange(256))
+                else:
+                    hit("/api/setColor?r=%d&g=%d&b=%d" % tuple(rng.randrange(256) for _ in range(3)))
+                time.sleep(DRAG_INTERVAL)
+        time.sleep(POLL_INTERVAL * rng.uniform(0.9, 1.1))
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(p / 100.0 * (len(ordered) - 1))))
+    return ordered[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--clients", type=int, default=4, help="同時模擬的瀏覽器數量")
+    parser.add_argument("--duration", type=float, default=30.0, help="測試秒數")
+    parser.add_argument("--timeout", type=float, default=5.0, help="單一請求逾時秒數")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    stats = Stats()
+    before = read_metrics(args.host, args.timeout)
+
+    started = time.time()
+    deadline = started + args.duration
+    threads = [threading.Thread(target=browser, args=(args.host, stats, deadline, args.timeout, args.seed + i))
+               for i in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.time() - started
+
+    after = read_metrics(args.host, args.timeout)
+
+    total = sum(len(v) for v in stats.latencies.values())
+    print("clients=%d duration=%.1fs requests=%d errors=%d" % (args.clients, elapsed, total, stats.errors))
+    print("throughput: %.1f req/s, %.1f KB/s received (%d bytes), %.1f KB/s sent (%d bytes)"
+          % (total / elapsed, stats.bytes_received / 1024.0 / elapsed, stats.bytes_received,
+             stats.bytes_sent / 1024.0 / elapsed, stats.bytes_sent))
+    print("%-20s %8s %10s %10s" % ("endpoint", "count", "p50 ms", "p99 ms"))
+    for path in sorted(stats.latencies):
+        values = stats.latencies[path]
+        print("%-20s %8d %10.1f %10.1f" % (path, len(values), percentile(values, 50) * 1000, percentile(values, 99) * 1000))
+
+    rendered = after["funxled_frames_rendered_total"] - before["funxled_frames_rendered_total"]
+    dropped = after["funxled_frames_dropped_total"] - before["funxled_frames_dropped_total"]
+    print("frames: rendered=%d dropped=%d (%.1f%% missed)"
+          % (rendered, dropped, 100.0 * dropped / max(1.0, rendered + dropped)))
+
+
+if __name__ == "__main__":
+    main()